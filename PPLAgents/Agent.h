@@ -1,21 +1,29 @@
 #pragma once
-#include <agents.h>
+#include <atomic>
+#include <chrono>
+#include <initializer_list>
+#include <optional>
+#include <vector>
+#include "Backend.h"
+#include "Scheduling.h"
+#include "Tracing.h"
 #include "Utils.h"
 
 namespace Agents
 {
 	// simple cancellation token implemented in terms of Concurrency::single_assignment<bool>
-	// can only be used to check if cancellation has been requested
+	// can only be used to check if cancellation has been requested.
+	// Checking is a lock-free atomic load, the single_assignment is there to support blocking (e.g. in a choice)
 	class CancellationToken
 	{
 	public:
-		bool IsCancellationRequested()
+		[[nodiscard]] bool IsCancellationRequested() const
 		{
-			return m_cancellationRequested || try_receive(m_target, m_cancellationRequested);
+			return m_cancellationRequested.load(std::memory_order_acquire);
 		}
 	private:
-		CancellationToken(Concurrency::single_assignment<bool>& target)
-			: m_target(target)
+		CancellationToken(Concurrency::single_assignment<bool>& target, const std::atomic<bool>& cancellationRequested)
+			: m_target(target), m_cancellationRequested(cancellationRequested)
 		{
 
 		}
@@ -23,35 +31,43 @@ namespace Agents
 		friend class CancellationTokenSource;
 
 		template<typename T>
-		friend bool Receive(Concurrency::ISource<T>& source, CancellationToken& cancellation, T& out, unsigned timeout);
+		friend class CancellableReceiver;
+
+		template<typename T, size_t Lanes>
+		friend class PriorityReceiver;
+
+		template<typename T>
+		friend class ReceiveAwaiter;
 
 		Concurrency::single_assignment<bool>& m_target;
-		bool m_cancellationRequested = false;
+		const std::atomic<bool>& m_cancellationRequested;
 	};
 
 	// simple cancellation source that decouples cancellation tokens from the cancel operation
 	// can be used to obtain multiple cancellation tokens that can be all cancelled by the same source
-	// (useful to control a group of workers)
+	// (useful to control a group of workers): all of them share the source flag
 	class CancellationTokenSource
 	{
 	public:
 		void Cancel()
 		{
+			// the flag is set first so that anyone woken up by m_target sees it
+			m_cancellationRequested.store(true, std::memory_order_release);
 			asend(m_target, true);
 		}
 
 		CancellationToken Token()
 		{
-			return { m_target };
+			return { m_target, m_cancellationRequested };
 		}
 
-		bool IsCancellationRequested()
+		[[nodiscard]] bool IsCancellationRequested() const
 		{
-			return m_cancelled || Concurrency::try_receive(m_target, m_cancelled);
+			return m_cancellationRequested.load(std::memory_order_acquire);
 		}
 	private:
 		Concurrency::single_assignment<bool> m_target;
-		bool m_cancelled = false;
+		std::atomic<bool> m_cancellationRequested = false;
 	};
 
 	// just like Concurrency::receive
@@ -75,6 +91,137 @@ namespace Agents
 		return try_receive(source, out);
 	}
 
+	// outcome of a receive with a timeout (see CancellableReceiver::ReceiveFor)
+	enum class ReceiveResult
+	{
+		Received,
+		Cancelled,
+		TimedOut
+	};
+
+	// receives from "source" until a cancellation is requested on "cancellation".
+	// Meant to be created once (e.g. per agent run) and reused for every message:
+	// - a cancellation already requested wins over pending data (like make_choice(&cancellation, &source))
+	// - if "source" has data, it's taken with try_receive (no choice block is involved)
+	// - only when "source" is empty, a choice on both is built to block until either produces a message.
+	// Concurrency::choice is backed by a single_assignment and can't be re-armed, that's why that one can't be reused.
+	template<typename T>
+	class CancellableReceiver
+	{
+	public:
+		CancellableReceiver(Concurrency::ISource<T>& source, CancellationToken& cancellation)
+			: m_source(source), m_cancellation(cancellation)
+		{
+
+		}
+
+		CancellableReceiver(const CancellableReceiver&) = delete;
+		CancellableReceiver& operator=(const CancellableReceiver&) = delete;
+
+		// returns true if a message has been received to "out", false if a cancellation has been requested.
+		// If "timeout" expires, Concurrency::receive is let throw an exception (ReceiveFor does not throw)
+		bool Receive(T& out, unsigned timeout = Concurrency::COOPERATIVE_TIMEOUT_INFINITE)
+		{
+			while (!m_cancellation.IsCancellationRequested())
+			{
+				if (try_receive(m_source, out))
+				{
+					return true;
+				}
+
+				auto messageSource = Concurrency::make_choice(&m_cancellation.m_target, &m_source);
+				auto messageIdx = receive(messageSource, timeout);
+				if (messageIdx != 1)
+				{
+					return false;
+				}
+				// has_value might be false if another consumer took the message: just retry (blocking again if nothing is left)
+				if (messageSource.has_value())
+				{
+					out = messageSource.template value<T>();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// like Receive, but an expired "timeout" is just a result: no exception is thrown (meant for frequent, short timeouts).
+		// "timeout" is the total time: it's not restarted when the message seen by the choice was taken by another consumer
+		ReceiveResult ReceiveFor(T& out, unsigned timeout)
+		{
+			if (timeout == Concurrency::COOPERATIVE_TIMEOUT_INFINITE)
+			{
+				return Receive(out) ? ReceiveResult::Received : ReceiveResult::Cancelled;
+			}
+
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+			while (!m_cancellation.IsCancellationRequested())
+			{
+				if (try_receive(m_source, out))
+				{
+					return ReceiveResult::Received;
+				}
+
+				const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+				if (remaining.count() <= 0)
+				{
+					return ReceiveResult::TimedOut;
+				}
+				const auto wait = static_cast<unsigned>(remaining.count());
+#if defined(PPLAGENTS_PORTABLE_BACKEND)
+				auto messageSource = Concurrency::make_choice(&m_cancellation.m_target, &m_source);
+				size_t messageIdx = 0;
+				if (!Concurrency::try_receive_for(messageSource, messageIdx, wait))
+				{
+					return ReceiveResult::TimedOut;
+				}
+#else
+				// ConcRT has no timed receive that doesn't throw: the timeout is one more source of the choice
+				Concurrency::timer<bool> timer{ wait, true };
+				auto messageSource = Concurrency::make_choice(&m_cancellation.m_target, &m_source, &timer);
+				timer.start();
+				const auto messageIdx = receive(messageSource);
+				if (messageIdx == 2)
+				{
+					return ReceiveResult::TimedOut;
+				}
+#endif
+				if (messageIdx != 1)
+				{
+					return ReceiveResult::Cancelled;
+				}
+				if (messageSource.has_value())
+				{
+					out = messageSource.template value<T>();
+					return ReceiveResult::Received;
+				}
+			}
+			return ReceiveResult::Cancelled;
+		}
+
+		// non-blocking: true if a message has been received to "out" (never when a cancellation has been requested)
+		bool TryReceive(T& out)
+		{
+			return !m_cancellation.IsCancellationRequested() && try_receive(m_source, out);
+		}
+
+		[[nodiscard]] bool IsCancellationRequested() const
+		{
+			return m_cancellation.IsCancellationRequested();
+		}
+	private:
+		Concurrency::ISource<T>& m_source;
+		CancellationToken& m_cancellation;
+	};
+
+	// the receiver of a consume loop on "source" (see AsyncConsumerAgent).
+	// Buffers that are not message blocks overload it for their own receiver, with the same interface (e.g. SpscBuffer)
+	template<typename T>
+	CancellableReceiver<T> MakeReceiver(Concurrency::ISource<T>& source, CancellationToken& cancellation)
+	{
+		return { source, cancellation };
+	}
+
 	// smart wrapper on top of Concurrency::receive that supports cancellation:
 	// this function can return because of either:
 	// - a message has been received from "source" to "out" [returns true]
@@ -83,23 +230,25 @@ namespace Agents
 	//
 	// This function can be used to implement the classical idiom:
 	// "stay (cooperatively) blocked receiving data until a cancellation has been requested"
+	// (prefer CancellableReceiver when receiving repeatedly from the same source)
 	template<typename T>
 	bool Receive(Concurrency::ISource<T>& source, CancellationToken& cancellation, T& out, unsigned timeout = Concurrency::COOPERATIVE_TIMEOUT_INFINITE)
 	{
-		auto received = false;
-		auto stop = false;
-		while (!received && !stop)
-		{
-			auto messageSource = Concurrency::make_choice(&cancellation.m_target, &source);
-			auto messageIdx = receive(messageSource, timeout);
-			stop = messageIdx != 1;
-			if (!stop && messageSource.has_value())
-			{
-				out = messageSource.template value<T>();
-				received = true;
-			}
-		}
-		return !stop;
+		return CancellableReceiver<T>{ source, cancellation }.Receive(out, timeout);
+	}
+
+	// like Receive above, but "timeout" expiring is reported as ReceiveResult::TimedOut instead of an exception:
+	//
+	// switch (ReceiveFor(buffer, token, value, 5))
+	// {
+	// case ReceiveResult::Received: Process(value); break;
+	// case ReceiveResult::TimedOut: Flush(); break;
+	// case ReceiveResult::Cancelled: return;
+	// }
+	template<typename T>
+	ReceiveResult ReceiveFor(Concurrency::ISource<T>& source, CancellationToken& cancellation, T& out, unsigned timeout)
+	{
+		return CancellableReceiver<T>{ source, cancellation }.ReceiveFor(out, timeout);
 	}
 	
 	enum class AgentStatus
@@ -116,45 +265,198 @@ namespace Agents
 	// - hides Concurrency::agent (in case you need to replace it with something else)
 	// - supports cancellation during execution (stop)
 	// - it does not support Concurrency::agent::cancel (cancellation 'before' execution)
+	// - Status() can be read from any thread while the agent runs
+	// - supervisors can block on a group of agents (WaitAny, WaitAll) instead of polling their status
 	class Agent : Concurrency::agent
 	{
 	public:
 		void Start()
 		{
-			start();
-			m_status = AgentStatus::Runnable;
+			Tracing::Instant(Tracing::EventType::Start, this);
+			// before start(): the agent thread might set Started (and Completed) right after
+			m_status.store(AgentStatus::Runnable, std::memory_order_release);
+			if (m_scheduler)
+			{
+				m_scheduler->Attached([this] { start(); });
+			}
+			else
+			{
+				start();
+			}
 		}
 		void Stop()
 		{
+			// a completed agent stays Completed
+			auto status = m_status.load(std::memory_order_acquire);
+			while (status != AgentStatus::Completed && status != AgentStatus::Waited && !m_status.compare_exchange_weak(status, AgentStatus::Stopped, std::memory_order_acq_rel))
+			{
+			}
+			Tracing::Instant(Tracing::EventType::Stop, this);
 			m_tokenSource.Cancel();
-			m_status = AgentStatus::Stopped;
 		}
 		void Wait()
 		{
 			wait(this);
-			m_status = AgentStatus::Waited;
+			m_status.store(AgentStatus::Waited, std::memory_order_release);
+		}
+		// waits at most "timeout" milliseconds: false if the agent is still running (then it must be waited again before destroying it)
+		bool Wait(unsigned timeout)
+		{
+			try
+			{
+				wait(this, timeout);
+			}
+			catch (const Concurrency::operation_timed_out&)
+			{
+				return false;
+			}
+			m_status.store(AgentStatus::Waited, std::memory_order_release);
+			return true;
 		}
 		void StopAndWait()
 		{
 			Stop();
 			Wait();
 		}
+		bool StopAndWait(unsigned timeout)
+		{
+			Stop();
+			return Wait(timeout);
+		}
 		[[nodiscard]] AgentStatus Status() const
 		{
-			return m_status;
+			return m_status.load(std::memory_order_acquire);
+		}
+
+		// blocks until one of "agents" has completed and returns its index (that agent is then Waited).
+		// The others keep running: the agents must outlive the call
+		//
+		// const auto first = Agent::WaitAny({ &downloader, &parser });
+		static size_t WaitAny(Utils::span<Agent* const> agents)
+		{
+			return *WaitAny(agents, Concurrency::COOPERATIVE_TIMEOUT_INFINITE);
+		}
+		static size_t WaitAny(std::initializer_list<Agent*> agents)
+		{
+			return WaitAny(Utils::span<Agent* const>{ agents.begin(), agents.size() });
+		}
+		// waits at most "timeout" milliseconds: nullopt if all the agents are still running
+		static std::optional<size_t> WaitAny(Utils::span<Agent* const> agents, unsigned timeout)
+		{
+			auto bases = BasesOf(agents);
+			Concurrency::agent_status status{};
+			size_t index = 0;
+			try
+			{
+				wait_for_one(bases.size(), bases.data(), status, index, timeout);
+			}
+			catch (const Concurrency::operation_timed_out&)
+			{
+				return std::nullopt;
+			}
+			agents[index]->m_status.store(AgentStatus::Waited, std::memory_order_release);
+			return index;
+		}
+		static std::optional<size_t> WaitAny(std::initializer_list<Agent*> agents, unsigned timeout)
+		{
+			return WaitAny(Utils::span<Agent* const>{ agents.begin(), agents.size() }, timeout);
+		}
+
+		// blocks until all of "agents" have completed (they are then Waited)
+		static void WaitAll(Utils::span<Agent* const> agents)
+		{
+			WaitAll(agents, Concurrency::COOPERATIVE_TIMEOUT_INFINITE);
+		}
+		static void WaitAll(std::initializer_list<Agent*> agents)
+		{
+			WaitAll(Utils::span<Agent* const>{ agents.begin(), agents.size() });
+		}
+		// waits at most "timeout" milliseconds: false if some agents are still running (then they must be waited again before destroying them)
+		static bool WaitAll(Utils::span<Agent* const> agents, unsigned timeout)
+		{
+			auto bases = BasesOf(agents);
+			std::vector<Concurrency::agent_status> statuses(bases.size());
+			try
+			{
+				wait_for_all(bases.size(), bases.data(), statuses.data(), timeout);
+			}
+			catch (const Concurrency::operation_timed_out&)
+			{
+				return false;
+			}
+			for (auto* agent : agents)
+			{
+				agent->m_status.store(AgentStatus::Waited, std::memory_order_release);
+			}
+			return true;
+		}
+		static bool WaitAll(std::initializer_list<Agent*> agents, unsigned timeout)
+		{
+			return WaitAll(Utils::span<Agent* const>{ agents.begin(), agents.size() }, timeout);
+		}
+		// the scheduler Start will run the agent on (to be called before Start, by default the current one)
+		void SetScheduler(Scheduler& scheduler)
+		{
+			m_scheduler = &scheduler;
 		}
 	protected:
 		virtual void Run(CancellationToken& cancellationToken) = 0;
+
+		// to be called by a Run that only starts the work (e.g. a coroutine, see CoroutineAgent) and returns without waiting for it:
+		// the agent is not completed when Run returns, but when Complete is called (once, by whoever finishes the work,
+		// possibly before Run returns)
+		void DeferCompletion()
+		{
+			*m_completionDeferred = true;
+		}
+
+		// the agent can be destroyed (by who is waiting) as soon as this is called
+		void Complete()
+		{
+			Tracing::Instant(Tracing::EventType::Complete, this);
+			m_status.store(AgentStatus::Completed, std::memory_order_release);
+			done();
+		}
 	private:
 		void run() override
 		{
-			m_status = AgentStatus::Started;
-			Utils::defer doneGuard([this] { done(); m_status = AgentStatus::Completed; });
+			// not if stopped before running
+			auto runnable = AgentStatus::Runnable;
+			m_status.compare_exchange_strong(runnable, AgentStatus::Started, std::memory_order_acq_rel);
+			// Complete() last: the agent can be destroyed as soon as it's called.
+			// With a deferred completion, the agent can be gone when Run returns: the flag lives here
+			auto completionDeferred = false;
+			m_completionDeferred = &completionDeferred;
+			const auto traced = Tracing::Enabled();
+			const auto started = traced ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+			Utils::defer doneGuard([this, &completionDeferred, traced, started] {
+				if (traced)
+				{
+					Tracing::Span(Tracing::EventType::Run, this, started, std::chrono::steady_clock::now() - started);
+				}
+				if (!completionDeferred)
+				{
+					Complete();
+				}
+			});
 			auto token = m_tokenSource.Token();
 			Run(token);
 		}
 
+		static std::vector<Concurrency::agent*> BasesOf(Utils::span<Agent* const> agents)
+		{
+			std::vector<Concurrency::agent*> bases;
+			bases.reserve(agents.size());
+			for (auto* agent : agents)
+			{
+				bases.push_back(agent);
+			}
+			return bases;
+		}
+
 		CancellationTokenSource m_tokenSource;
-		AgentStatus m_status = AgentStatus::Created;
+		std::atomic<AgentStatus> m_status = AgentStatus::Created;
+		Scheduler* m_scheduler = nullptr;
+		bool* m_completionDeferred = nullptr; // the flag of the running run (see DeferCompletion)
 	};
 }
\ No newline at end of file
@@ -1,8 +1,103 @@
 #pragma once
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "Utils.h"
 
 namespace Agents
 {
+	class CancellationToken;
+
+	namespace Details
+	{
+		template<typename Buffer, typename = void>
+		struct HasSize : std::false_type {};
+
+		template<typename Buffer>
+		struct HasSize<Buffer, std::void_t<decltype(std::declval<const Buffer&>().Size())>> : std::true_type {};
+
+		template<typename Buffer, typename = void>
+		struct HasSeal : std::false_type {};
+
+		template<typename Buffer>
+		struct HasSeal<Buffer, std::void_t<decltype(std::declval<Buffer&>().Seal())>> : std::true_type {};
+
+		// called by the policies draining last values, before taking any: seals "buffer" if it can be (e.g. BoundedBuffer),
+		// so that what is sent from now on is rejected, and returns the backlog (the most the drain takes).
+		// A buffer that can't tell its size (e.g. unbounded_buffer) is drained until it's empty
+		template<typename Buffer>
+		size_t SealBacklog(Buffer& buffer)
+		{
+			if constexpr (HasSeal<Buffer>::value)
+			{
+				buffer.Seal();
+			}
+			if constexpr (HasSize<Buffer>::value)
+			{
+				return buffer.Size();
+			}
+			else
+			{
+				return (std::numeric_limits<size_t>::max)();
+			}
+		}
+
+		template<typename Policy, size_t Parts, typename = void>
+		struct SplitAcross
+		{
+			using type = Policy;
+		};
+
+		template<typename Policy, size_t Parts>
+		struct SplitAcross<Policy, Parts, std::void_t<typename Policy::template SplitAcross<Parts>>>
+		{
+			using type = typename Policy::template SplitAcross<Parts>;
+		};
+
+		// the last values policy of one of "Parts" buffers drained in parallel: the budget of a policy having one (e.g. BoundedDrain)
+		// is split among them, the others are used as they are
+		template<typename Policy, size_t Parts>
+		using SplitLastValuesPolicy = typename SplitAcross<Policy, Parts>::type;
+
+		template<typename Policy, typename = void>
+		struct HasBudget : std::false_type {};
+
+		template<typename Policy>
+		struct HasBudget<Policy, std::void_t<typename Policy::Budget>> : std::true_type {};
+
+		template<typename Policy, typename Buffer, typename = void>
+		struct HasDrain : std::false_type {};
+
+		// the policy can drain "Buffer" one value at a time (see RetainLastValues::Drain)
+		template<typename Policy, typename Buffer>
+		struct HasDrain<Policy, Buffer, std::void_t<typename Policy::template Drain<Buffer>>> : std::true_type {};
+
+		// drains "buffers" one after the other (e.g. lanes in priority order) with Policy::Process: a policy having a Budget
+		// (e.g. BoundedDrain) shares one among all of them, so the deadline and the count are not multiplied by the number of buffers
+		template<typename Policy, typename Buffers, typename Consumer>
+		void ProcessInOrder(Buffers buffers, size_t count, Consumer consumer)
+		{
+			if constexpr (HasBudget<Policy>::value)
+			{
+				typename Policy::Budget budget;
+				for (size_t index = 0; index < count; ++index)
+				{
+					Policy::Process(buffers(index), [&](auto&& val) { consumer(index, std::forward<decltype(val)>(val)); }, budget);
+				}
+			}
+			else
+			{
+				for (size_t index = 0; index < count; ++index)
+				{
+					Policy::Process(buffers(index), [&](auto&& val) { consumer(index, std::forward<decltype(val)>(val)); });
+				}
+			}
+		}
+	}
+
 	namespace Skills
 	{
 		template<typename T>
@@ -32,10 +127,12 @@ namespace Agents
 			}
 		};
 
+		// starts once the whole AgentComposer is constructed (see OnComposed), so it can be placed anywhere:
+		// starting from a base constructor would let the agent run on an object still being constructed
 		template<typename T>
 		struct AutoStart
 		{
-			AutoStart()
+			void OnComposed()
 			{
 				static_cast<T&>(*this).Start();
 			}
@@ -50,16 +147,70 @@ namespace Agents
 		template<typename T>
 		struct ManualWait { };
 
-		// policy to process last values
+		// policy to process last values: the backlog at the time the drain starts (see Details::SealBacklog), not what is sent afterwards
 		struct RetainLastValues
 		{
+			// takes the last values one at a time, for a consumer that can't be called back (e.g. an async Consume, see CoroutineAsyncConsumerAgent)
+			template<typename Buffer>
+			class Drain
+			{
+			public:
+				explicit Drain(Buffer& buffer)
+					: m_buffer(buffer), m_left(Details::SealBacklog(buffer))
+				{
+
+				}
+
+				template<typename U>
+				bool TryTake(U& out)
+				{
+					if (m_left == 0 || !try_receive(m_buffer, out))
+					{
+						return false;
+					}
+					--m_left;
+					return true;
+				}
+
+				void Finish()
+				{
+				}
+			private:
+				Buffer& m_buffer;
+				size_t m_left;
+			};
+
 			template<typename Buffer, typename Consumer>
 			static void Process(Buffer& buffer, Consumer consumer)
 			{
+				Drain<Buffer> drain{ buffer };
 				decltype(Utils::detect(buffer)) received;
-				while (try_receive(buffer, received))
+				while (drain.TryTake(received))
+				{
+					consumer(std::move(received));
+				}
+			}
+
+			// same as Process but hands values over in batches of at most "maxBatchSize" elements
+			template<typename Buffer, typename BatchConsumer>
+			static void ProcessBatch(Buffer& buffer, BatchConsumer batchConsumer, size_t maxBatchSize)
+			{
+				using payloadType = decltype(Utils::detect(buffer));
+				std::vector<payloadType> batch;
+				batch.reserve(maxBatchSize);
+				payloadType received{};
+				for (auto left = Details::SealBacklog(buffer); left > 0 && try_receive(buffer, received); --left)
+				{
+					batch.push_back(std::move(received));
+					if (batch.size() == maxBatchSize)
+					{
+						batchConsumer(Utils::span<payloadType>{ batch.data(), batch.size() });
+						batch.clear();
+					}
+				}
+				if (!batch.empty())
 				{
-					consumer(received);
+					batchConsumer(Utils::span<payloadType>{ batch.data(), batch.size() });
 				}
 			}
 		};
@@ -67,16 +218,439 @@ namespace Agents
 		// policy to ignore last values
 		struct DropLastValues
 		{
+			template<typename Buffer>
+			struct Drain
+			{
+				explicit Drain(Buffer&)
+				{
+				}
+
+				template<typename U>
+				bool TryTake(U&)
+				{
+					return false;
+				}
+
+				void Finish()
+				{
+				}
+			};
+
 			template<typename Buffer, typename Consumer>
-			static void Process(Buffer&, Consumer&)
+			static void Process(Buffer&, Consumer)
+			{
+			}
+
+			template<typename Buffer, typename BatchConsumer>
+			static void ProcessBatch(Buffer&, BatchConsumer, size_t)
 			{
 			}
 		};
+
+		// what BoundedDrain does with the values left: nothing, they stay in the buffer (like DropLastValues)
+		struct LeaveRest
+		{
+			template<typename Buffer>
+			static void Process(Buffer&)
+			{
+			}
+		};
+
+		// what BoundedDrain does with the values left: they are sent to Provider::Target() (e.g. a buffer another instance replays)
+		// struct Spill { static Concurrency::ITarget<Order>& Target() { static Concurrency::unbounded_buffer<Order> spill; return spill; } };
+		template<typename Provider>
+		struct SpillTo
+		{
+			template<typename Buffer>
+			static void Process(Buffer& buffer)
+			{
+				auto& target = Provider::Target();
+				decltype(Utils::detect(buffer)) received{};
+				for (auto left = Details::SealBacklog(buffer); left > 0 && try_receive(buffer, received); --left)
+				{
+					send(target, received);
+				}
+			}
+		};
+
+		// policy to process last values for at most MaxMilliseconds and MaxMessages, then Rest::Process the others (see LeaveRest and SpillTo).
+		// It bounds how long stopping an agent with a large backlog takes:
+		// AsyncConsumer<MyConsumer, AutoStart, AutoStop, AutoWait, BoundedDrain<500, 100000, SpillTo<Spill>>>
+		// Agents draining "Parts" buffers in parallel (PartitionedAsyncConsumerAgent) give each one SplitAcross<Parts>: MaxMessages in total,
+		// the deadline is the same for all (they run at the same time). Agents draining several buffers one after the other
+		// (PriorityAsyncConsumerAgent) share one Budget among them
+		template<unsigned MaxMilliseconds, size_t MaxMessages = (std::numeric_limits<size_t>::max)(), typename Rest = LeaveRest>
+		struct BoundedDrain
+		{
+			template<size_t Parts>
+			using SplitAcross = BoundedDrain<MaxMilliseconds, MaxMessages == (std::numeric_limits<size_t>::max)() ? MaxMessages : MaxMessages / Parts, Rest>;
+
+			// what is left to drain, shared by buffers drained one after the other (see Details::ProcessInOrder)
+			struct Budget
+			{
+				std::chrono::steady_clock::time_point Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(MaxMilliseconds);
+				size_t Messages = MaxMessages;
+			};
+
+			// takes the last values one at a time within "budget" (see RetainLastValues::Drain), Finish hands the others to Rest
+			template<typename Buffer>
+			class Drain
+			{
+			public:
+				explicit Drain(Buffer& buffer, Budget budget = {})
+					: m_buffer(buffer), m_budget(budget), m_left((std::min)(budget.Messages, Details::SealBacklog(buffer)))
+				{
+
+				}
+
+				// the deadline is checked before taking a value, so that no value is taken and then left
+				template<typename U>
+				bool TryTake(U& out)
+				{
+					if (m_left == 0 || std::chrono::steady_clock::now() >= m_budget.Deadline || !try_receive(m_buffer, out))
+					{
+						return false;
+					}
+					--m_left;
+					--m_budget.Messages;
+					return true;
+				}
+
+				void Finish()
+				{
+					Rest::Process(m_buffer);
+				}
+
+				[[nodiscard]] const Budget& Left() const
+				{
+					return m_budget;
+				}
+			private:
+				Buffer& m_buffer;
+				Budget m_budget;
+				size_t m_left;
+			};
+
+			template<typename Buffer, typename Consumer>
+			static void Process(Buffer& buffer, Consumer consumer)
+			{
+				Budget budget;
+				Process(buffer, std::move(consumer), budget);
+			}
+
+			template<typename Buffer, typename Consumer>
+			static void Process(Buffer& buffer, Consumer consumer, Budget& budget)
+			{
+				Drain<Buffer> drain{ buffer, budget };
+				decltype(Utils::detect(buffer)) received;
+				while (drain.TryTake(received))
+				{
+					consumer(std::move(received));
+				}
+				budget = drain.Left();
+				drain.Finish();
+			}
+
+			template<typename Buffer, typename BatchConsumer>
+			static void ProcessBatch(Buffer& buffer, BatchConsumer batchConsumer, size_t maxBatchSize)
+			{
+				using payloadType = decltype(Utils::detect(buffer));
+				const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(MaxMilliseconds);
+				std::vector<payloadType> batch;
+				batch.reserve(maxBatchSize);
+				payloadType received{};
+				for (auto left = (std::min)(MaxMessages, Details::SealBacklog(buffer)); left > 0 && std::chrono::steady_clock::now() < deadline; left -= batch.size())
+				{
+					batch.clear();
+					while (batch.size() < maxBatchSize && batch.size() < left && try_receive(buffer, received))
+					{
+						batch.push_back(std::move(received));
+					}
+					if (batch.empty())
+					{
+						break;
+					}
+					batchConsumer(Utils::span<payloadType>{ batch.data(), batch.size() });
+				}
+				Rest::Process(buffer);
+			}
+		};
 	}
 
+	namespace Skills
+	{
+		// what a skill decides about the lifetime of the agent (see SkillTraits)
+		struct Decides
+		{
+			static constexpr unsigned Nothing = 0;
+			static constexpr unsigned Start = 1;
+			static constexpr unsigned Stop = 2;
+			static constexpr unsigned Wait = 4;
+		};
+
+		template<unsigned DecisionsV, unsigned OnDestructionV = Decides::Nothing, bool ObservesV = false>
+		struct SkillTraitsOf
+		{
+			static constexpr unsigned Decisions = DecisionsV; // at most one skill per decision (e.g. not AutoStop and ManualStop)
+			static constexpr unsigned OnDestruction = OnDestructionV; // done by its destructor: the skill that waits is placed before the one that stops
+			static constexpr bool Observes = ObservesV; // needs the whole run: placed before the skills stopping or waiting on destruction
+		};
+
+		// checked by AgentComposer at compile time. Skills deciding or observing the lifetime of the agent specialize it:
+		// template<> struct SkillTraits<MySkill> : SkillTraitsOf<Decides::Nothing, Decides::Nothing, true> {};
+		template<template<typename> typename Skill>
+		struct SkillTraits : SkillTraitsOf<Decides::Nothing> {};
+
+		template<> struct SkillTraits<AutoStart> : SkillTraitsOf<Decides::Start> {};
+		template<> struct SkillTraits<ManualStart> : SkillTraitsOf<Decides::Start> {};
+		template<> struct SkillTraits<AutoStop> : SkillTraitsOf<Decides::Stop, Decides::Stop> {};
+		template<> struct SkillTraits<ManualStop> : SkillTraitsOf<Decides::Stop> {};
+		template<> struct SkillTraits<AutoWait> : SkillTraitsOf<Decides::Wait, Decides::Wait> {};
+		template<> struct SkillTraits<ManualWait> : SkillTraitsOf<Decides::Wait> {};
+		template<> struct SkillTraits<AutoStopAndWait> : SkillTraitsOf<Decides::Stop | Decides::Wait, Decides::Stop | Decides::Wait> {};
+	}
+
+	namespace Details
+	{
+		template<template<typename> typename... AgentSkills>
+		constexpr bool ComposesOnce(unsigned decision)
+		{
+			return ((Skills::SkillTraits<AgentSkills>::Decisions & decision ? 1 : 0) + ... + 0) <= 1;
+		}
+
+		// position of the first skill doing "action" on destruction (sizeof...(AgentSkills) if none)
+		template<template<typename> typename... AgentSkills>
+		constexpr size_t FirstOnDestruction(unsigned action)
+		{
+			constexpr unsigned onDestruction[] = { Skills::SkillTraits<AgentSkills>::OnDestruction..., 0 };
+			size_t index = 0;
+			while (index < sizeof...(AgentSkills) && !(onDestruction[index] & action))
+			{
+				++index;
+			}
+			return index;
+		}
+
+		// true if the skill waiting on destruction (if any) is destroyed after the one stopping (if any)
+		template<template<typename> typename... AgentSkills>
+		constexpr bool WaitsAfterStopping()
+		{
+			const auto waits = FirstOnDestruction<AgentSkills...>(Skills::Decides::Wait);
+			const auto stops = FirstOnDestruction<AgentSkills...>(Skills::Decides::Stop);
+			return waits == sizeof...(AgentSkills) || stops == sizeof...(AgentSkills) || waits <= stops;
+		}
+
+		// true if every observing skill comes before the skills stopping or waiting on destruction
+		template<template<typename> typename... AgentSkills>
+		constexpr bool ObserversFirst()
+		{
+			constexpr bool observes[] = { Skills::SkillTraits<AgentSkills>::Observes..., false };
+			const auto firstOnDestruction = FirstOnDestruction<AgentSkills...>(Skills::Decides::Stop | Skills::Decides::Wait);
+			for (size_t index = firstOnDestruction; index < sizeof...(AgentSkills); ++index)
+			{
+				if (observes[index])
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		template<typename Skill, typename = void>
+		struct HasOnComposed : std::false_type {};
+		template<typename Skill>
+		struct HasOnComposed<Skill, std::void_t<decltype(&Skill::OnComposed)>> : std::true_type {};
+
+		template<typename Skill, typename = void>
+		struct HasOnBeforeConsume : std::false_type {};
+		template<typename Skill>
+		struct HasOnBeforeConsume<Skill, std::void_t<decltype(&Skill::OnBeforeConsume)>> : std::true_type {};
+
+		template<typename Skill, typename = void>
+		struct HasOnAfterConsume : std::false_type {};
+		template<typename Skill>
+		struct HasOnAfterConsume<Skill, std::void_t<decltype(&Skill::OnAfterConsume)>> : std::true_type {};
+
+		template<typename Skill, typename = void>
+		struct HasOnMessage : std::false_type {};
+		template<typename Skill>
+		struct HasOnMessage<Skill, std::void_t<decltype(&Skill::OnMessage)>> : std::true_type {};
+
+		template<typename Skill, typename = void>
+		struct HasOnIdle : std::false_type {};
+		template<typename Skill>
+		struct HasOnIdle<Skill, std::void_t<decltype(&Skill::OnIdle)>> : std::true_type {};
+
+		// the hooks of a consume loop when no skill has any: everything compiles away
+		struct NoHooks
+		{
+			static constexpr bool Idle = false; // OnIdle needs a (non-blocking) try before blocking: only then it's done
+
+			void OnBeforeConsume(size_t)
+			{
+			}
+
+			void OnAfterConsume(size_t)
+			{
+			}
+
+			template<typename T>
+			void OnMessage(const T&)
+			{
+			}
+
+			void OnIdle()
+			{
+			}
+		};
+
+		// the hooks of a consume loop, statically dispatched to the skills (of "Composer") having them
+		template<typename Composer, typename... Skills>
+		class SkillHooks
+		{
+		public:
+			static constexpr bool Any = ((HasOnBeforeConsume<Skills>::value || HasOnAfterConsume<Skills>::value || HasOnMessage<Skills>::value || HasOnIdle<Skills>::value) || ...);
+			static constexpr bool Idle = (HasOnIdle<Skills>::value || ...);
+
+			SkillHooks(Composer& composer, CancellationToken& cancellationToken)
+				: m_composer(composer), m_cancellationToken(cancellationToken)
+			{
+
+			}
+
+			void OnBeforeConsume(size_t messages)
+			{
+				(BeforeConsume<Skills>(messages), ...);
+			}
+
+			void OnAfterConsume(size_t messages)
+			{
+				(AfterConsume<Skills>(messages), ...);
+			}
+
+			template<typename T>
+			void OnMessage(const T& message)
+			{
+				(Message<Skills>(message), ...);
+			}
+
+			void OnIdle()
+			{
+				(Idling<Skills>(), ...);
+			}
+		private:
+			template<typename Skill>
+			void BeforeConsume(size_t messages)
+			{
+				if constexpr (HasOnBeforeConsume<Skill>::value)
+				{
+					if constexpr (std::is_invocable_v<decltype(&Skill::OnBeforeConsume), Skill&, size_t, CancellationToken&>)
+					{
+						static_cast<Skill&>(m_composer).OnBeforeConsume(messages, m_cancellationToken);
+					}
+					else
+					{
+						static_cast<Skill&>(m_composer).OnBeforeConsume(messages);
+					}
+				}
+			}
+
+			template<typename Skill>
+			void AfterConsume(size_t messages)
+			{
+				if constexpr (HasOnAfterConsume<Skill>::value)
+				{
+					static_cast<Skill&>(m_composer).OnAfterConsume(messages);
+				}
+			}
+
+			template<typename Skill, typename T>
+			void Message(const T& message)
+			{
+				if constexpr (HasOnMessage<Skill>::value)
+				{
+					static_cast<Skill&>(m_composer).OnMessage(message);
+				}
+			}
+
+			template<typename Skill>
+			void Idling()
+			{
+				if constexpr (HasOnIdle<Skill>::value)
+				{
+					static_cast<Skill&>(m_composer).OnIdle();
+				}
+			}
+
+			Composer& m_composer;
+			CancellationToken& m_cancellationToken;
+		};
+
+		// "static constexpr bool RejectsSkillHooks = true" opts a Behavior out (it overrides Run with a loop that can't run hooks)
+		template<typename Behavior, typename = void>
+		struct RejectsSkillHooks : std::false_type {};
+
+		template<typename Behavior>
+		struct RejectsSkillHooks<Behavior, std::void_t<decltype(Behavior::RejectsSkillHooks)>> : std::bool_constant<Behavior::RejectsSkillHooks> {};
+
+		// Behavior running its loops with the hooks of the skills: it must have "template<typename Hooks> void RunWithHooks(CancellationToken&, Hooks&)"
+		// (e.g. AsyncConsumerAgent)
+		template<typename Composer, typename Behavior, typename... Skills>
+		class HookedBehavior : public Behavior
+		{
+			static_assert(!RejectsSkillHooks<Behavior>::value, "this agent doesn't support skills with consume loop hooks (e.g. RateLimited, Recorded, TracedFlow)");
+		public:
+			using Behavior::Behavior;
+		protected:
+			void Run(CancellationToken& cancellationToken) override
+			{
+				SkillHooks<Composer, Skills...> hooks{ static_cast<Composer&>(*this), cancellationToken };
+				this->RunWithHooks(cancellationToken, hooks);
+			}
+		};
+
+		// Behavior itself unless a skill has hooks (then zero cost when unused)
+		template<typename Composer, typename Behavior, typename... Skills>
+		using ComposedBehavior = std::conditional_t<SkillHooks<Composer, Skills...>::Any, HookedBehavior<Composer, Behavior, Skills...>, Behavior>;
+
+		template<typename Skill, typename Composer>
+		void Composed(Composer& composer)
+		{
+			if constexpr (HasOnComposed<Skill>::value)
+			{
+				static_cast<Skill&>(composer).OnComposed();
+			}
+		}
+	}
+
+	// Behavior with AgentSkills, each one a base class (so, constructed in order and destroyed in reverse order).
+	// Checked at compile time (see Skills::SkillTraits):
+	// - at most one skill for starting, stopping and waiting (e.g. not AutoStop with AutoStopAndWait)
+	// - the skill waiting on destruction is placed before the one stopping (otherwise the destructor waits forever)
+	// - skills observing the run (e.g. Instrumented) are placed before those stopping or waiting on destruction
+	//
+	// Skills can have (public):
+	// - "void OnComposed()", called once the whole agent is constructed (e.g. AutoStart)
+	// - consume loop hooks "void OnBeforeConsume(size_t messages)" (or "(size_t messages, CancellationToken& token)", to wait cancellably,
+	//   e.g. RateLimited), "void OnAfterConsume(size_t messages)" (if Consume has not thrown),
+	//   "void OnMessage(const T& message)" (each message, as received, before it's moved into Consume) and
+	//   "void OnIdle()" (the buffer is empty: the loop is going to block), statically dispatched by Behaviors supporting them
+	//   (e.g. AsyncConsumerAgent, called by all the loops of ParallelAsyncConsumerAgent; rejected at compile time by
+	//   CoroutineAsyncConsumerAgent). Without hooks, Behavior is used as it is
 	template<typename Behavior, template<typename> typename... AgentSkills>
-	struct AgentComposer : Behavior, AgentSkills<AgentComposer<Behavior, AgentSkills...>>...
+	struct AgentComposer : Details::ComposedBehavior<AgentComposer<Behavior, AgentSkills...>, Behavior, AgentSkills<AgentComposer<Behavior, AgentSkills...>>...>, AgentSkills<AgentComposer<Behavior, AgentSkills...>>...
 	{
-		using Behavior::Behavior;
+		static_assert(Details::ComposesOnce<AgentSkills...>(Skills::Decides::Start), "more than one skill decides how to start (e.g. AutoStart and ManualStart)");
+		static_assert(Details::ComposesOnce<AgentSkills...>(Skills::Decides::Stop), "more than one skill decides how to stop (e.g. AutoStop and AutoStopAndWait)");
+		static_assert(Details::ComposesOnce<AgentSkills...>(Skills::Decides::Wait), "more than one skill decides how to wait (e.g. AutoWait and AutoStopAndWait)");
+		static_assert(Details::WaitsAfterStopping<AgentSkills...>(), "place AutoWait before AutoStop: bases are destroyed in reverse order, waiting before stopping hangs forever");
+		static_assert(Details::ObserversFirst<AgentSkills...>(), "place observing skills (e.g. Instrumented) before those stopping or waiting on destruction");
+
+		template<typename... Args, typename = std::enable_if_t<std::is_constructible_v<Behavior, Args&&...>>>
+		explicit AgentComposer(Args&&... args)
+			: Details::ComposedBehavior<AgentComposer, Behavior, AgentSkills<AgentComposer>...>(std::forward<Args>(args)...)
+		{
+			(Details::Composed<AgentSkills<AgentComposer>>(*this), ...);
+		}
 	};
-}
\ No newline at end of file
+}
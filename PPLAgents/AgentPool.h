@@ -0,0 +1,347 @@
+#pragma once
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "Agent.h"
+#include "PooledBuffer.h"
+#include "Scheduling.h"
+
+namespace Agents
+{
+	// Keeps warm agents to run short-lived work without constructing (and scheduling) a new agent each time:
+	// Concurrency::agent can be started only once, so each worker is a long-lived agent waiting for the next job.
+	// Work is described by a Behavior, written like an Agent (but not deriving from it):
+	//
+	// class Resize
+	// {
+	// public:
+	//    explicit Resize(Image& image) : m_image(image) {}
+	// protected:
+	//    void Run(CancellationToken& cancellationToken)
+	//    {
+	//       ...
+	//    }
+	// private:
+	//    Image& m_image;
+	// };
+	//
+	// AgentPool<Resize> pool{ 4 }; // 4 warm workers
+	//
+	// A Lease hands a free worker out (a new one is added if none is free), with a Behavior constructed for it and a fresh
+	// CancellationToken. It's started, stopped and waited like an Agent, so AgentComposer skills apply per lease:
+	//
+	// {
+	//    AgentComposer<AgentPool<Resize>::Lease, AutoStart, AutoStopAndWait> resize{ pool, image };
+	//    ...
+	// } // stopped, waited and back to the pool
+	//
+	// The worker goes back to the pool when the lease is destroyed (waiting for the job, if started).
+	// A job that throws completes its lease (Error() gives the exception) and its worker stays warm for the next one.
+	// A warm worker is an agent blocked on receive (on the portable backend, one thread of the scheduler).
+	// The pool must outlive its leases
+	template<typename Behavior>
+	class AgentPool
+	{
+		class Worker;
+	public:
+		class Lease
+		{
+		public:
+			// "args" are given to the Behavior constructor
+			template<typename... Args>
+			explicit Lease(AgentPool& pool, Args&&... args)
+				: m_pool(pool), m_worker(pool.Acquire())
+			{
+				m_worker.Prepare(std::forward<Args>(args)...);
+			}
+
+			Lease(const Lease&) = delete;
+			Lease& operator=(const Lease&) = delete;
+
+			~Lease()
+			{
+				// the job might still use the Behavior: it can't be given to someone else before
+				Wait();
+				m_worker.Reset();
+				m_pool.Release(m_worker);
+			}
+
+			void Start()
+			{
+				if (!std::exchange(m_started, true))
+				{
+					m_worker.StartJob();
+				}
+			}
+			void Stop()
+			{
+				m_worker.StopJob();
+			}
+			// returns immediately if the lease has never been started
+			void Wait()
+			{
+				if (m_started && !m_waited)
+				{
+					m_worker.WaitJob(Concurrency::COOPERATIVE_TIMEOUT_INFINITE);
+				}
+				Waited();
+			}
+			// waits at most "timeout" milliseconds: false if the job is still running
+			bool Wait(unsigned timeout)
+			{
+				if (m_started && !m_waited && !m_worker.WaitJob(timeout))
+				{
+					return false;
+				}
+				Waited();
+				return true;
+			}
+			void StopAndWait()
+			{
+				Stop();
+				Wait();
+			}
+			bool StopAndWait(unsigned timeout)
+			{
+				Stop();
+				return Wait(timeout);
+			}
+			[[nodiscard]] AgentStatus Status() const
+			{
+				return m_worker.JobStatus();
+			}
+
+			// what the job has thrown (nullptr if it hasn't), once waited
+			[[nodiscard]] std::exception_ptr Error() const
+			{
+				return m_worker.JobError();
+			}
+
+			Behavior& operator*()
+			{
+				return m_worker.Job();
+			}
+			Behavior* operator->()
+			{
+				return &m_worker.Job();
+			}
+		private:
+			void Waited()
+			{
+				m_waited = true;
+				m_worker.Waited();
+			}
+
+			AgentPool& m_pool;
+			Worker& m_worker;
+			bool m_started = false;
+			bool m_waited = false;
+		};
+
+		explicit AgentPool(size_t warmWorkers = 0)
+		{
+			Warm(warmWorkers);
+		}
+
+		// workers run on "scheduler" (that must outlive the pool)
+		AgentPool(size_t warmWorkers, Scheduler& scheduler)
+			: m_scheduler(&scheduler)
+		{
+			Warm(warmWorkers);
+		}
+
+		AgentPool(const AgentPool&) = delete;
+		AgentPool& operator=(const AgentPool&) = delete;
+
+		~AgentPool()
+		{
+			for (auto& worker : m_workers)
+			{
+				worker->Retire();
+			}
+			for (auto& worker : m_workers)
+			{
+				worker->Wait();
+			}
+		}
+
+		// workers created so far (the others have been reused)
+		[[nodiscard]] size_t Workers() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_workers.size();
+		}
+	private:
+		// runs the jobs of the leases it's given to, one at a time, until the pool is destroyed
+		class Worker : public Agent
+		{
+		public:
+			template<typename... Args>
+			void Prepare(Args&&... args)
+			{
+				m_job.emplace(std::forward<Args>(args)...);
+				m_cancellation.emplace();
+				m_error = nullptr;
+				m_jobStatus.store(AgentStatus::Created, std::memory_order_release);
+			}
+
+			void Reset()
+			{
+				m_job.reset();
+				m_cancellation.reset();
+			}
+
+			// starts the job (the Agent itself has been started by the pool)
+			void StartJob()
+			{
+				auto created = AgentStatus::Created;
+				m_jobStatus.compare_exchange_strong(created, AgentStatus::Runnable, std::memory_order_acq_rel);
+				Send(m_jobs, true);
+			}
+
+			void StopJob()
+			{
+				// a completed job stays Completed
+				auto status = m_jobStatus.load(std::memory_order_acquire);
+				while (status != AgentStatus::Completed && status != AgentStatus::Waited && !m_jobStatus.compare_exchange_weak(status, AgentStatus::Stopped, std::memory_order_acq_rel))
+				{
+				}
+				m_cancellation->Cancel();
+			}
+
+			bool WaitJob(unsigned timeout)
+			{
+				try
+				{
+					receive(m_finished, timeout);
+				}
+				catch (const Concurrency::operation_timed_out&)
+				{
+					return false;
+				}
+				return true;
+			}
+
+			// the worker exits after the current job (if any)
+			void Retire()
+			{
+				Send(m_jobs, false);
+			}
+
+			void Waited()
+			{
+				m_jobStatus.store(AgentStatus::Waited, std::memory_order_release);
+			}
+
+			AgentStatus JobStatus() const
+			{
+				return m_jobStatus.load(std::memory_order_acquire);
+			}
+
+			// written before m_finished is sent, read after it's received
+			std::exception_ptr JobError() const
+			{
+				return m_error;
+			}
+
+			Behavior& Job()
+			{
+				return *m_job;
+			}
+		protected:
+			// the pool stops workers with Retire, so the only thing to wait for is m_jobs (no choice with the cancellation)
+			void Run(CancellationToken&) override
+			{
+				while (receive(m_jobs))
+				{
+					auto runnable = AgentStatus::Runnable;
+					m_jobStatus.compare_exchange_strong(runnable, AgentStatus::Started, std::memory_order_acq_rel);
+					// the lease is waiting for m_finished even if the job throws
+					Utils::defer finishedGuard([this] {
+						m_jobStatus.store(AgentStatus::Completed, std::memory_order_release);
+						Send(m_finished, true);
+					});
+					auto token = m_cancellation->Token();
+					// caught per job: the worker keeps serving the pool
+					try
+					{
+						m_job->Execute(token);
+					}
+					catch (...)
+					{
+						m_error = std::current_exception();
+					}
+				}
+			}
+		private:
+			// Run might be protected, as in agents
+			struct Task : Behavior
+			{
+				using Behavior::Behavior;
+
+				void Execute(CancellationToken& cancellationToken)
+				{
+					this->Run(cancellationToken);
+				}
+			};
+
+			std::optional<Task> m_job;
+			std::optional<CancellationTokenSource> m_cancellation; // a fresh one per lease
+			std::atomic<AgentStatus> m_jobStatus = AgentStatus::Created;
+			std::exception_ptr m_error;
+			// pooled messages: a lease doesn't allocate
+			PooledBuffer<bool> m_jobs;
+			PooledBuffer<bool> m_finished;
+		};
+
+		void Warm(size_t workers)
+		{
+			for (size_t i = 0; i < workers; ++i)
+			{
+				m_free.push_back(&Add());
+			}
+		}
+
+		Worker& Add()
+		{
+			auto worker = std::make_unique<Worker>();
+			if (m_scheduler)
+			{
+				worker->SetScheduler(*m_scheduler);
+			}
+			worker->Start();
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_workers.push_back(std::move(worker));
+			return *m_workers.back();
+		}
+
+		Worker& Acquire()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_free.empty())
+				{
+					auto* worker = m_free.back();
+					m_free.pop_back();
+					return *worker;
+				}
+			}
+			return Add();
+		}
+
+		void Release(Worker& worker)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_free.push_back(&worker);
+		}
+
+		Scheduler* m_scheduler = nullptr;
+		mutable std::mutex m_mutex;
+		std::vector<std::unique_ptr<Worker>> m_workers;
+		std::vector<Worker*> m_free; // warm and leased to no one
+	};
+}
@@ -1,13 +1,22 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <vector>
 #include "Agent.h"
 #include "AgentComposer.h"
+#include "Coalescing.h"
+#include "DiscardTarget.h"
+#include "Metrics.h"
+#include "ReceivePolicies.h"
 
 namespace Agents
 {
 	// An agent implementing the classical pattern:
 	// "consume all messages from an async source by performing an action on them all individually".
 	// It supports also a policy for consuming latest messages (those staying in the queue after stopping the agent).
-	// The consumer can be stopped by throwing an exception. In this case, its buffer will be linked to a "null buffer".
+	// The consumer can be stopped by throwing an exception. In this case, its buffer will be linked to a DiscardTarget owned by the agent
+	// (messages sent to the buffer afterwards are destroyed and counted in DroppedMessages()).
 	// 
 	// Basically, you define a "Consumer" class like:
 	//
@@ -30,42 +39,423 @@ namespace Agents
 	//
 	// This one will ignore values received after being stopped:
 	// AsyncConsumerAgent<MyConsumer, DropLastValues> agent;
+	//
+	// ReceivePolicy decides how to wait for the next message (see Skills::BlockingReceive and Skills::AdaptiveSpinReceive):
+	// AsyncConsumerAgent<MyConsumer, RetainLastValues, AdaptiveSpinReceive<>> agent; // spins a bit before blocking
+	//
+	// For "latest value wins" feeds, Skills::CoalescingReceive and Skills::CoalesceLastValues collapse pending messages (per key):
+	// AsyncConsumerAgent<MyConsumer, CoalesceLastValues<>, CoalescingReceive<int>> agent; // Consume sees only the newest value
+	//
+	// Batching (opt-in): if the Consumer exposes "void ConsumeBatch(Utils::span<T>)", the agent blocks for the first message,
+	// then drains up to MaxBatchSize - 1 more with try_receive and hands them over as one contiguous batch.
+	// The Consumer can optionally tune batching with:
+	//
+	// static constexpr size_t MaxBatchSize = 256; // default: DefaultMaxBatchSize
+	// static constexpr unsigned MaxBatchLatency = 5; // milliseconds to wait for a batch to fill up (default: 0, do not wait)
+	//
+	// In batching mode, Consume is not required and LastMessagesPolicy::ProcessBatch is used for the last values.
+	//
+	// Periodic work (opt-in): if the Consumer exposes "void OnTick()", the agent calls it about every TickInterval milliseconds,
+	// both while consuming and while idle (receiving with a timeout, that expires without exceptions: see ReceiveResult).
+	// Useful for time-based flushes without a second timer agent:
+	//
+	// static constexpr unsigned TickInterval = 10; // default: DefaultTickInterval
+	//
+	// OnTick runs on the agent loop (never concurrently with Consume) and it's not called for the last values.
+	// Agents running more than one loop don't support it (ParallelAsyncConsumerAgent rejects it at compile time).
+	//
+	// Received values are moved into Consume (so "void Consume(T&&)" or "void Consume(T)" can take ownership) and into batches.
+	// Values wrapped in Utils::Movable are unwrapped first: with a Concurrency::unbounded_buffer<Utils::Movable<std::unique_ptr<X>>>
+	// Consume can be "void Consume(std::unique_ptr<X>)".
 	// 
-	template<typename Consumer, typename LastMessagesPolicy = Skills::RetainLastValues>
+	template<typename Consumer, typename LastMessagesPolicy = Skills::RetainLastValues, typename ReceivePolicy = Skills::BlockingReceive>
 	class AsyncConsumerAgent : public Consumer, public Agent
 	{
 	public:
 		using Consumer::Consumer;
+
+		~AsyncConsumerAgent()
+		{
+			if (m_discarding)
+			{
+				this->m_buffer.unlink_target(&m_discard);
+			}
+		}
+
+		static constexpr size_t DefaultMaxBatchSize = 64;
+		static constexpr unsigned DefaultTickInterval = 100;
+
+		// the buffer this agent consumes from (e.g. for skills that configure or monitor it)
+		auto& Buffer()
+		{
+			return this->m_buffer;
+		}
+
+		// starts (or stops, if nullptr) recording into "metrics" (see Skills::Instrumented)
+		void AttachMetrics(AgentMetrics* metrics)
+		{
+			m_metrics.store(metrics, std::memory_order_release);
+		}
+
+		// messages discarded after Consume has thrown (see DiscardIncomingMessages)
+		[[nodiscard]] uint64_t DroppedMessages() const
+		{
+			return m_discard.Dropped();
+		}
 	protected:
+		// the agent Receive and Consume spans are traced as (this by default): loops running for another agent trace as that one
+		// (e.g. the shards of PartitionedAsyncConsumerAgent)
+		void TraceAs(const Agent& agent)
+		{
+			m_tracedAs = &agent;
+		}
+
 		void Run(CancellationToken& cancellationToken) override
+		{
+			Details::NoHooks hooks;
+			RunWithHooks(cancellationToken, hooks);
+		}
+
+		// Run calling "hooks" (see AgentComposer)
+		template<typename Hooks>
+		void RunWithHooks(CancellationToken& cancellationToken, Hooks& hooks)
+		{
+			try
+			{
+				ConsumeUntilCancelled(cancellationToken, hooks);
+				ProcessLastValues(hooks);
+			}
+			catch (const std::exception&)
+			{
+				DiscardIncomingMessages();
+			}
+		}
+
+		void ConsumeUntilCancelled(CancellationToken& cancellationToken)
+		{
+			Details::NoHooks hooks;
+			ConsumeUntilCancelled(cancellationToken, hooks);
+		}
+
+		// stays (cooperatively) blocked consuming messages until a cancellation is requested.
+		// Consume exceptions are let propagate
+		template<typename Hooks>
+		void ConsumeUntilCancelled(CancellationToken& cancellationToken, Hooks& hooks)
 		{
 			auto& buffer = this->m_buffer;
 			using payloadType = decltype(Utils::detect(buffer));
 
-			try
+			auto receiver = MakeReceiver(buffer, cancellationToken);
+			ReceivePolicy receivePolicy; // one per loop, it might keep state
+			payloadType received{};
+			auto nextTick = FirstTick();
+			if constexpr (SupportsBatch<payloadType>(0))
+			{
+				constexpr auto maxBatchSize = BatchSize();
+				std::vector<payloadType> batch;
+				batch.reserve(maxBatchSize);
+				for (auto result = ReceiveResult::TimedOut; result != ReceiveResult::Cancelled; TickIfDue(nextTick))
+				{
+					result = ReceiveHooked(receivePolicy, receiver, received, TimeToTick(nextTick), hooks);
+					if (result == ReceiveResult::Received)
+					{
+						batch.push_back(std::move(received));
+						FillBatch(receivePolicy, receiver, batch, maxBatchSize);
+						for (const auto& message : batch)
+						{
+							hooks.OnMessage(message);
+						}
+						ConsumeMeasured(hooks, batch.size(), [&] {
+							this->ConsumeBatch(Utils::span<payloadType>{ batch.data(), batch.size() });
+						});
+						batch.clear();
+					}
+				}
+			}
+			else
 			{
-				payloadType received{};
-				while (Receive(buffer, cancellationToken, received))
+				for (auto result = ReceiveResult::TimedOut; result != ReceiveResult::Cancelled; TickIfDue(nextTick))
 				{
-					this->Consume(received);
+					result = ReceiveHooked(receivePolicy, receiver, received, TimeToTick(nextTick), hooks);
+					if (result == ReceiveResult::Received)
+					{
+						hooks.OnMessage(received);
+						ConsumeMeasured(hooks, 1, [&] {
+							this->Consume(Utils::Unwrap(std::move(received)));
+						});
+					}
 				}
-				LastMessagesPolicy::Process(buffer, [this](auto val) {
-					this->Consume(val);
+			}
+		}
+
+		void ProcessLastValues()
+		{
+			Details::NoHooks hooks;
+			ProcessLastValues(hooks);
+		}
+
+		// processes the messages staying in the buffer (after the cancellation) according to LastMessagesPolicy
+		template<typename Hooks>
+		void ProcessLastValues(Hooks& hooks)
+		{
+			auto& buffer = this->m_buffer;
+			using payloadType = decltype(Utils::detect(buffer));
+
+			if constexpr (SupportsBatch<payloadType>(0))
+			{
+				LastMessagesPolicy::ProcessBatch(buffer, [&](Utils::span<payloadType> values) {
+					for (const auto& message : values)
+					{
+						hooks.OnMessage(message);
+					}
+					ConsumeMeasured(hooks, values.size(), [&] {
+						this->ConsumeBatch(values);
+					});
+				}, BatchSize());
+			}
+			else
+			{
+				LastMessagesPolicy::Process(buffer, [&](auto&& val) {
+					hooks.OnMessage(val);
+					ConsumeMeasured(hooks, 1, [&] {
+						this->Consume(Utils::Unwrap(std::forward<decltype(val)>(val)));
+					});
 				});
 			}
-			catch (const std::exception&)
+		}
+
+		// since the consumer has failed and this Agent will be AgentStatus::Completed when returning to the caller,
+		// we link its buffer to a (per agent) target that destroys and counts whatever is pending or sent afterwards.
+		// The agent unlinks it when destroyed (not when Run exits: messages sent later are still discarded), so a buffer
+		// the Consumer only refers to (e.g. ISource<T>& m_buffer) must outlive the agent
+		void DiscardIncomingMessages()
+		{
+			m_discarding = true;
+			this->m_buffer.link_target(&m_discard);
+		}
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		// ReceiveMeasured calling OnIdle when the buffer is empty (only if "hooks" has it: otherwise there's no extra try)
+		template<typename Receiver, typename T, typename Hooks>
+		ReceiveResult ReceiveHooked(ReceivePolicy& policy, Receiver& receiver, T& out, unsigned timeout, Hooks& hooks)
+		{
+			if constexpr (Hooks::Idle)
+			{
+				if (policy.TryReceive(receiver, out))
+				{
+					return ReceiveResult::Received;
+				}
+				if (!receiver.IsCancellationRequested())
+				{
+					hooks.OnIdle();
+				}
+			}
+			return ReceiveMeasured(policy, receiver, out, timeout);
+		}
+
+		// receives with "receiver" (according to "policy"), adding the time spent waiting to the attached metrics (if any) and to the trace
+		template<typename Receiver, typename T>
+		ReceiveResult ReceiveMeasured(ReceivePolicy& policy, Receiver& receiver, T& out, unsigned timeout)
+		{
+			auto* metrics = m_metrics.load(std::memory_order_acquire);
+			if (!metrics && !Tracing::Enabled())
+			{
+				return policy.Receive(receiver, out, timeout);
+			}
+			const auto start = Clock::now();
+			const auto result = policy.Receive(receiver, out, timeout);
+			const auto elapsed = Clock::now() - start;
+			if (metrics)
 			{
-				static Concurrency::overwrite_buffer<payloadType> NullBuffer;
-				// since the consumer has failed and this Agent will be AgentStatus::Completed when returning to the caller,
-				// we link its buffer to an overwrite_buffer that will behave like a "null consumer"
-				buffer.link_target(&NullBuffer);
+				metrics->AddReceiveWait(elapsed);
 			}
+			Tracing::Span(Tracing::EventType::Receive, m_tracedAs, start, elapsed);
+			return result;
 		}
+
+		// OnTick support: without OnTick, receiving never times out and the clock is not read
+		static Clock::time_point FirstTick()
+		{
+			if constexpr (HasTick(0))
+			{
+				return Clock::now() + TickPeriod();
+			}
+			else
+			{
+				return {};
+			}
+		}
+
+		// milliseconds to wait for a message before OnTick is due
+		static unsigned TimeToTick(Clock::time_point nextTick)
+		{
+			if constexpr (HasTick(0))
+			{
+				const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(nextTick - Clock::now()).count();
+				return remaining > 0 ? static_cast<unsigned>(remaining) : 0;
+			}
+			else
+			{
+				return Concurrency::COOPERATIVE_TIMEOUT_INFINITE;
+			}
+		}
+
+		void TickIfDue(Clock::time_point& nextTick)
+		{
+			if constexpr (HasTick(0))
+			{
+				const auto now = Clock::now();
+				if (now >= nextTick)
+				{
+					this->OnTick();
+					// not catching up on missed ticks: the next one is an interval from now
+					nextTick = now + TickPeriod();
+				}
+			}
+		}
+
+		static constexpr std::chrono::milliseconds TickPeriod()
+		{
+			constexpr auto interval = TickIntervalOf<AsyncConsumerAgent>(nullptr);
+			static_assert(interval > 0, "TickInterval must be positive");
+			return std::chrono::milliseconds(interval);
+		}
+
+		// calls "consume" (handling "messages" messages) between the hooks, adding its duration to the attached metrics (if any) and to the trace
+		template<typename Hooks, typename ConsumeFunc>
+		void ConsumeMeasured(Hooks& hooks, size_t messages, ConsumeFunc consume)
+		{
+			hooks.OnBeforeConsume(messages);
+			auto* metrics = m_metrics.load(std::memory_order_acquire);
+			if (!metrics && !Tracing::Enabled())
+			{
+				consume();
+			}
+			else
+			{
+				const auto start = Clock::now();
+				consume();
+				const auto elapsed = Clock::now() - start;
+				if (metrics)
+				{
+					metrics->AddConsumed(messages, elapsed);
+				}
+				Tracing::Span(Tracing::EventType::Consume, m_tracedAs, start, elapsed, messages);
+			}
+			hooks.OnAfterConsume(messages);
+		}
+
+		static constexpr size_t BatchSize()
+		{
+			constexpr auto maxBatchSize = MaxBatchSizeOf<AsyncConsumerAgent>(nullptr);
+			static_assert(maxBatchSize > 0, "MaxBatchSize must be positive");
+			return maxBatchSize;
+		}
+
+		// appends to "batch" until it's full, the buffer is empty and MaxBatchLatency is expired, or a cancellation is requested
+		template<typename Receiver, typename T>
+		static void FillBatch(ReceivePolicy& policy, Receiver& receiver, std::vector<T>& batch, size_t maxBatchSize)
+		{
+			constexpr auto maxLatency = std::chrono::milliseconds(MaxBatchLatencyOf<AsyncConsumerAgent>(nullptr));
+			const auto deadline = std::chrono::steady_clock::now() + maxLatency;
+			T received{};
+			while (batch.size() < maxBatchSize)
+			{
+				if (policy.TryReceive(receiver, received))
+				{
+					batch.push_back(std::move(received));
+					continue;
+				}
+				if constexpr (maxLatency.count() == 0)
+				{
+					return;
+				}
+				else
+				{
+					const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+					if (remaining.count() <= 0)
+					{
+						return;
+					}
+					if (policy.Receive(receiver, received, static_cast<unsigned>(remaining.count())) != ReceiveResult::Received)
+					{
+						return;
+					}
+					batch.push_back(std::move(received));
+				}
+			}
+		}
+
+		// Consumer members might be protected, so detection happens here (where they are accessible)
+		template<typename T, typename Self = AsyncConsumerAgent>
+		static constexpr auto SupportsBatch(int) -> decltype(std::declval<Self&>().ConsumeBatch(std::declval<Utils::span<T>>()), bool())
+		{
+			return true;
+		}
+
+		template<typename T>
+		static constexpr bool SupportsBatch(...)
+		{
+			return false;
+		}
+
+		template<typename Self = AsyncConsumerAgent>
+		static constexpr auto HasTick(int) -> decltype(std::declval<Self&>().OnTick(), bool())
+		{
+			return true;
+		}
+
+		static constexpr bool HasTick(...)
+		{
+			return false;
+		}
+
+		template<typename Self>
+		static constexpr unsigned TickIntervalOf(decltype(Self::TickInterval)*)
+		{
+			return Self::TickInterval;
+		}
+
+		template<typename Self>
+		static constexpr unsigned TickIntervalOf(...)
+		{
+			return DefaultTickInterval;
+		}
+
+		template<typename Self>
+		static constexpr size_t MaxBatchSizeOf(decltype(Self::MaxBatchSize)*)
+		{
+			return Self::MaxBatchSize;
+		}
+
+		template<typename Self>
+		static constexpr size_t MaxBatchSizeOf(...)
+		{
+			return DefaultMaxBatchSize;
+		}
+
+		template<typename Self>
+		static constexpr unsigned MaxBatchLatencyOf(decltype(Self::MaxBatchLatency)*)
+		{
+			return Self::MaxBatchLatency;
+		}
+
+		template<typename Self>
+		static constexpr unsigned MaxBatchLatencyOf(...)
+		{
+			return 0;
+		}
+
+		std::atomic<AgentMetrics*> m_metrics = nullptr;
+		const Agent* m_tracedAs = this;
+		DiscardTarget<decltype(Utils::detect(AsyncConsumerAgent::m_buffer))> m_discard;
+		bool m_discarding = false; // written by Run, read on destruction (after Wait)
 	};
 
 	// Use AgentComposer to pass Start and Stop skills to AsyncConsumerAgent
 	// Examples:
 	// using AutoStartAsyncConsumer = AsyncConsumer<MyConsumer, AutoStart, ManualStop, ManualWait, RetainLastValues>
-	template<typename Consumer, template <typename> typename StartPolicy, template <typename> typename StopPolicy, template <typename> typename WaitPolicy, typename LastValuesPolicy>
-	using AsyncConsumer = AgentComposer<AsyncConsumerAgent<Consumer, LastValuesPolicy>, StartPolicy, WaitPolicy, StopPolicy>;
+	template<typename Consumer, template <typename> typename StartPolicy, template <typename> typename StopPolicy, template <typename> typename WaitPolicy, typename LastValuesPolicy, typename ReceivePolicy = Skills::BlockingReceive>
+	using AsyncConsumer = AgentComposer<AsyncConsumerAgent<Consumer, LastValuesPolicy, ReceivePolicy>, StartPolicy, WaitPolicy, StopPolicy>;
 }
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+// Selects the execution backend Concurrency:: refers to in the whole library:
+// - Windows: the Concurrency Runtime (<agents.h>)
+// - elsewhere, or if PPLAGENTS_PORTABLE_BACKEND is defined: Agents::Portable, same names and semantics on top of the standard library
+#if !defined(_WIN32) && !defined(PPLAGENTS_PORTABLE_BACKEND)
+#define PPLAGENTS_PORTABLE_BACKEND
+#endif
+
+#if defined(PPLAGENTS_PORTABLE_BACKEND)
+#include "Portable/Agents.h"
+namespace Concurrency = Agents::Portable;
+#else
+#include <agents.h>
+#endif
\ No newline at end of file
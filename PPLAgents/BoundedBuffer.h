@@ -0,0 +1,254 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include "Agent.h"
+#include "AgentComposer.h"
+
+namespace Agents
+{
+	// An unbounded_buffer with a high-water mark: it can be used wherever an unbounded_buffer is, also as a Consumer m_buffer.
+	// Producers using Agents::Send are blocked while Size() >= Capacity(), so they slow down instead of filling up the heap.
+	//
+	// - messages arriving by other means (e.g. Concurrency::send or linked sources) are counted but never blocked
+	// - the mark is "soft": concurrent producers might exceed it by at most the number of producers minus one
+	// - BlockedTime() reports the total time producers have spent blocked
+	// - once sealed (by the drain of last values, see Details::SealBacklog), every message is rejected: send and Send return false
+	//   and Rejected() counts them. Producers blocked waiting for space are woken up (and rejected)
+	//
+	// BoundedBuffer<int> buffer{ 1000 };
+	// Send(buffer, 42); // blocks if 1000 messages are pending
+	// Send(buffer, 42, token); // same but returns false if a cancellation is requested on token while blocked
+	//
+	template<typename T>
+	class BoundedBuffer : public Concurrency::unbounded_buffer<T>
+	{
+		using Base = Concurrency::unbounded_buffer<T>;
+	public:
+		explicit BoundedBuffer(size_t capacity = (std::numeric_limits<size_t>::max)())
+			: m_capacity(capacity)
+		{
+
+		}
+
+		void SetCapacity(size_t capacity)
+		{
+			m_capacity = capacity;
+			NotifySpace();
+		}
+
+		[[nodiscard]] size_t Capacity() const
+		{
+			return m_capacity.load(std::memory_order_relaxed);
+		}
+
+		// number of messages in the buffer (pending)
+		[[nodiscard]] size_t Size() const
+		{
+			return m_size.load(std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] std::chrono::nanoseconds BlockedTime() const
+		{
+			return std::chrono::nanoseconds{ m_blockedTime.load(std::memory_order_relaxed) };
+		}
+
+		// rejects all the messages from now on (it can't be undone)
+		void Seal()
+		{
+			if (m_sealed.exchange(true))
+			{
+				return;
+			}
+			// after m_sealed is set: a producer not counted here sees it before blocking
+			for (auto waiters = m_waiters.load(); waiters > 0; --waiters)
+			{
+				++m_notified;
+				asend(m_space, true);
+			}
+		}
+
+		[[nodiscard]] bool IsSealed() const
+		{
+			return m_sealed.load();
+		}
+
+		// messages rejected because the buffer was sealed
+		[[nodiscard]] size_t Rejected() const
+		{
+			return m_rejected.load(std::memory_order_relaxed);
+		}
+	protected:
+		Concurrency::message_status propagate_message(Concurrency::message<T>* message, Concurrency::ISource<T>* source) override
+		{
+			if (IsSealed())
+			{
+				return Reject();
+			}
+			++m_size; // before the message is in the buffer, otherwise a consumer taking it right away would underflow m_size
+			return Uncount(Base::propagate_message(message, source));
+		}
+
+		Concurrency::message_status send_message(Concurrency::message<T>* message, Concurrency::ISource<T>* source) override
+		{
+			if (IsSealed())
+			{
+				return Reject();
+			}
+			++m_size;
+			return Uncount(Base::send_message(message, source));
+		}
+
+		Concurrency::message<T>* accept_message(Concurrency::runtime_object_identity id) override
+		{
+			return Uncount(Base::accept_message(id));
+		}
+
+		Concurrency::message<T>* consume_message(Concurrency::runtime_object_identity id) override
+		{
+			return Uncount(Base::consume_message(id));
+		}
+
+#if defined(PPLAGENTS_PORTABLE_BACKEND)
+		Concurrency::message<T>* take_message() override
+		{
+			return Uncount(Base::take_message());
+		}
+#endif
+	private:
+		template<typename U>
+		friend bool Send(BoundedBuffer<U>& target, const U& value, CancellationToken& cancellation);
+
+		template<typename U>
+		friend bool Send(BoundedBuffer<U>& target, const U& value);
+
+		// waits (cooperatively) until there is space (or the buffer is sealed), "block" is called to block until something changes
+		// (it returns true once it has received a notification from m_space)
+		template<typename Block>
+		bool WaitForSpace(Block block)
+		{
+			if (Size() < Capacity())
+			{
+				return true;
+			}
+
+			const auto start = std::chrono::steady_clock::now();
+			++m_waiters; // before checking again, otherwise a consumer might not see it
+			Utils::defer waitGuard([&] {
+				--m_waiters;
+				m_blockedTime.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+			});
+			while (Size() >= Capacity() && !IsSealed())
+			{
+				if (!block())
+				{
+					return false;
+				}
+				--m_notified; // one notification taken
+			}
+			return true;
+		}
+
+		Concurrency::message_status Reject()
+		{
+			m_rejected.fetch_add(1, std::memory_order_relaxed);
+			return Concurrency::declined;
+		}
+
+		// called after a message has been offered (and already counted), to revert the count if it was not accepted
+		Concurrency::message_status Uncount(Concurrency::message_status status)
+		{
+			if (status != Concurrency::accepted)
+			{
+				--m_size;
+			}
+			return status;
+		}
+
+		Concurrency::message<T>* Uncount(Concurrency::message<T>* message)
+		{
+			if (message)
+			{
+				--m_size;
+				NotifySpace();
+			}
+			return message;
+		}
+
+		// wakes up one blocked producer, unless there are already as many notifications pending as producers blocked:
+		// notifications don't pile up under sustained backpressure (one left by a cancelled producer is just spurious, producers check again)
+		void NotifySpace()
+		{
+			auto notified = m_notified.load();
+			do
+			{
+				if (notified >= m_waiters.load())
+				{
+					return;
+				}
+			} while (!m_notified.compare_exchange_weak(notified, notified + 1));
+			asend(m_space, true);
+		}
+
+		std::atomic<size_t> m_capacity;
+		std::atomic<size_t> m_size = 0;
+		std::atomic<size_t> m_waiters = 0;
+		std::atomic<size_t> m_notified = 0; // sent to m_space and not received yet
+		std::atomic<long long> m_blockedTime = 0;
+		std::atomic<bool> m_sealed = false;
+		std::atomic<size_t> m_rejected = 0;
+		Concurrency::unbounded_buffer<bool> m_space;
+	};
+
+	// sends "value" to "target", staying (cooperatively) blocked while "target" is full.
+	// Returns false if "target" has been sealed (the value is rejected)
+	template<typename T>
+	bool Send(BoundedBuffer<T>& target, const T& value)
+	{
+		target.WaitForSpace([&] {
+			receive(target.m_space);
+			return true;
+		});
+		return send(target, value);
+	}
+
+	// like Send but supports cancellation (same semantics as the cancellable Receive):
+	// - "value" has been sent to "target" [returns true]
+	// - a cancellation has been requested on "cancellation" while waiting for space [returns false, "value" is not sent]
+	// - "target" has been sealed [returns false, "value" is rejected]
+	template<typename T>
+	bool Send(BoundedBuffer<T>& target, const T& value, CancellationToken& cancellation)
+	{
+		CancellableReceiver<bool> spaceReceiver{ target.m_space, cancellation };
+		auto space = false;
+		if (!target.WaitForSpace([&] { return spaceReceiver.Receive(space); }))
+		{
+			return false;
+		}
+		return send(target, value);
+	}
+
+	namespace Skills
+	{
+		// sets the capacity of the agent m_buffer (which must be a BoundedBuffer) and reports how long producers spent blocked.
+		// The capacity is set once the whole agent is constructed (see OnComposed), before AutoStart starts it if placed before it
+		// AgentComposer<AsyncConsumerAgent<MyConsumer>, Bounded<1000>::Skill, AutoStart, AutoStopAndWait>
+		template<size_t Capacity>
+		struct Bounded
+		{
+			template<typename T>
+			struct Skill
+			{
+				void OnComposed()
+				{
+					static_cast<T&>(*this).Buffer().SetCapacity(Capacity);
+				}
+
+				[[nodiscard]] std::chrono::nanoseconds ProducersBlockedTime()
+				{
+					return static_cast<T&>(*this).Buffer().BlockedTime();
+				}
+			};
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,212 @@
+#pragma once
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "AgentComposer.h"
+#include "ReceivePolicies.h"
+
+namespace Agents
+{
+	namespace Skills
+	{
+		// key extractor for coalescing: all messages have the same key, so only the newest one is consumed
+		struct SameKey
+		{
+			template<typename T>
+			bool operator()(const T&) const
+			{
+				return true;
+			}
+		};
+	}
+
+	namespace Details
+	{
+		// collapses values with the same key (according to KeyOf) into the newest one, keeping the order of first arrival.
+		// Values are added only when nothing is pending (so a value can't supersede one that has already been popped)
+		template<typename T, typename KeyOf>
+		class Coalescer
+		{
+		public:
+			void Add(T&& value)
+			{
+				if constexpr (std::is_same_v<KeyOf, Skills::SameKey>)
+				{
+					if (m_values.empty())
+					{
+						m_values.push_back(std::move(value));
+					}
+					else
+					{
+						m_values.back() = std::move(value);
+					}
+				}
+				else
+				{
+					const auto [it, inserted] = m_indexes.try_emplace(m_keyOf(value), m_values.size());
+					if (inserted)
+					{
+						m_values.push_back(std::move(value));
+					}
+					else
+					{
+						m_values[it->second] = std::move(value);
+					}
+				}
+			}
+
+			bool Pop(T& out)
+			{
+				if (m_next == m_values.size())
+				{
+					return false;
+				}
+				out = std::move(m_values[m_next++]);
+				if (m_next == m_values.size())
+				{
+					m_values.clear();
+					m_next = 0;
+					if constexpr (!std::is_same_v<KeyOf, Skills::SameKey>)
+					{
+						m_indexes.clear();
+					}
+				}
+				return true;
+			}
+		private:
+			struct NoIndexes
+			{
+			};
+
+			using Key = std::decay_t<std::invoke_result_t<KeyOf&, const T&>>;
+			// SameKey needs no lookup: the only pending value is replaced
+			using Indexes = std::conditional_t<std::is_same_v<KeyOf, Skills::SameKey>, NoIndexes, std::unordered_map<Key, size_t>>;
+
+			KeyOf m_keyOf;
+			std::vector<T> m_values;
+			size_t m_next = 0;
+			Indexes m_indexes;
+		};
+	}
+
+	namespace Skills
+	{
+		// "latest value wins" for high-rate state updates (prices, snapshots, sensor readings):
+		// when the agent wakes up, it takes what is in the buffer (up to MaxCollected messages) and collapses values with the same key
+		// (KeyOf()(value), by default SameKey: just the newest value), so Consume sees only the newest value of each key,
+		// in order of first arrival. Superseded values are dropped without calling Consume.
+		// Messages are waited for (and taken) with ReceivePolicy.
+		//
+		// struct BySymbol { std::string operator()(const Tick& tick) const { return tick.Symbol; } };
+		// AsyncConsumerAgent<PriceConsumer, CoalesceLastValues<BySymbol>, CoalescingReceive<Tick, BySymbol>> agent{ buffer };
+		//
+		// Values already collapsed are handed over even if a cancellation is requested meanwhile (they've been taken from the buffer).
+		// With ParallelAsyncConsumerAgent, each consumer coalesces what it takes
+		template<typename T, typename KeyOf = SameKey, typename ReceivePolicy = BlockingReceive>
+		class CoalescingReceive
+		{
+		public:
+			static constexpr size_t MaxCollected = 4096; // so that a producer faster than the consumer can't keep it collecting forever
+
+			template<typename Receiver>
+			ReceiveResult Receive(Receiver& receiver, T& out, unsigned timeout = Concurrency::COOPERATIVE_TIMEOUT_INFINITE)
+			{
+				if (m_pending.Pop(out))
+				{
+					return ReceiveResult::Received;
+				}
+				const auto result = m_receive.Receive(receiver, out, timeout);
+				if (result == ReceiveResult::Received)
+				{
+					Collect(receiver, out);
+				}
+				return result;
+			}
+
+			template<typename Receiver>
+			bool TryReceive(Receiver& receiver, T& out)
+			{
+				if (m_pending.Pop(out))
+				{
+					return true;
+				}
+				if (!m_receive.TryReceive(receiver, out))
+				{
+					return false;
+				}
+				Collect(receiver, out);
+				return true;
+			}
+		private:
+			// collapses "out" (just received) with what's in the buffer, then "out" is the first value to consume
+			template<typename Receiver>
+			void Collect(Receiver& receiver, T& out)
+			{
+				m_pending.Add(std::move(out));
+				T next{};
+				for (size_t i = 1; i < MaxCollected && m_receive.TryReceive(receiver, next); ++i)
+				{
+					m_pending.Add(std::move(next));
+				}
+				m_pending.Pop(out);
+			}
+
+			ReceivePolicy m_receive;
+			Details::Coalescer<T, KeyOf> m_pending;
+		};
+
+		// policy to process last values, like RetainLastValues but only the newest value of each key (see CoalescingReceive)
+		template<typename KeyOf = SameKey>
+		struct CoalesceLastValues
+		{
+			template<typename Buffer, typename Consumer>
+			static void Process(Buffer& buffer, Consumer consumer)
+			{
+				using payloadType = decltype(Utils::detect(buffer));
+				auto pending = Collect(buffer);
+				payloadType value{};
+				while (pending.Pop(value))
+				{
+					consumer(std::move(value));
+				}
+			}
+
+			template<typename Buffer, typename BatchConsumer>
+			static void ProcessBatch(Buffer& buffer, BatchConsumer batchConsumer, size_t maxBatchSize)
+			{
+				using payloadType = decltype(Utils::detect(buffer));
+				auto pending = Collect(buffer);
+				std::vector<payloadType> batch;
+				batch.reserve(maxBatchSize);
+				payloadType value{};
+				while (pending.Pop(value))
+				{
+					batch.push_back(std::move(value));
+					if (batch.size() == maxBatchSize)
+					{
+						batchConsumer(Utils::span<payloadType>{ batch.data(), batch.size() });
+						batch.clear();
+					}
+				}
+				if (!batch.empty())
+				{
+					batchConsumer(Utils::span<payloadType>{ batch.data(), batch.size() });
+				}
+			}
+		private:
+			template<typename Buffer>
+			static auto Collect(Buffer& buffer)
+			{
+				using payloadType = decltype(Utils::detect(buffer));
+				Details::Coalescer<payloadType, KeyOf> pending;
+				payloadType received{};
+				for (auto left = Details::SealBacklog(buffer); left > 0 && try_receive(buffer, received); --left)
+				{
+					pending.Add(std::move(received));
+				}
+				return pending;
+			}
+		};
+	}
+}
@@ -0,0 +1,573 @@
+#pragma once
+// C++20 coroutine flavour of agents: available (and PPLAGENTS_COROUTINES defined) only when compiling as C++20 or later
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define PPLAGENTS_COROUTINES
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Agent.h"
+#include "AsyncConsumer.h"
+
+namespace Agents
+{
+	// the coroutine type of RunAsync (and of what it co_awaits): it starts when co_awaited (or when the agent runs).
+	// An exception escaping a Task is rethrown to who co_awaits it, as with Run it must not escape RunAsync (that terminates)
+	class Task
+	{
+	public:
+		struct promise_type
+		{
+			Task get_return_object()
+			{
+				return Task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+			}
+
+			std::suspend_always initial_suspend() noexcept
+			{
+				return {};
+			}
+
+			auto final_suspend() noexcept
+			{
+				return FinalAwaiter{};
+			}
+
+			void return_void()
+			{
+
+			}
+
+			void unhandled_exception()
+			{
+				if (!continuation)
+				{
+					std::terminate();
+				}
+				exception = std::current_exception();
+			}
+
+			std::coroutine_handle<> continuation; // who co_awaits this task
+			std::function<void()> onDone; // if started with Start
+			std::exception_ptr exception;
+		};
+
+		Task() = default;
+
+		Task(Task&& other) noexcept
+			: m_handle(std::exchange(other.m_handle, {}))
+		{
+
+		}
+
+		Task& operator=(Task&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Destroy();
+				m_handle = std::exchange(other.m_handle, {});
+			}
+			return *this;
+		}
+
+		Task(const Task&) = delete;
+		Task& operator=(const Task&) = delete;
+
+		~Task()
+		{
+			Destroy();
+		}
+
+		// runs the task until it suspends (or finishes): "onDone" is called when it finishes (on the thread finishing it).
+		// The task can be destroyed as soon as "onDone" is called (not before)
+		void Start(std::function<void()> onDone)
+		{
+			m_handle.promise().onDone = std::move(onDone);
+			m_handle.resume();
+		}
+
+		auto operator co_await() && noexcept
+		{
+			struct Awaiter
+			{
+				bool await_ready() noexcept
+				{
+					return false;
+				}
+
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+				{
+					handle.promise().continuation = awaiting;
+					return handle;
+				}
+
+				void await_resume()
+				{
+					if (auto exception = handle.promise().exception)
+					{
+						std::rethrow_exception(exception);
+					}
+				}
+
+				std::coroutine_handle<promise_type> handle;
+			};
+			return Awaiter{ m_handle };
+		}
+	private:
+		explicit Task(std::coroutine_handle<promise_type> handle)
+			: m_handle(handle)
+		{
+
+		}
+
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+			{
+				auto& promise = handle.promise();
+				if (promise.continuation)
+				{
+					return promise.continuation;
+				}
+				// the frame can be destroyed by onDone: nothing of it is touched afterwards
+				if (auto onDone = std::move(promise.onDone))
+				{
+					onDone();
+				}
+				return std::noop_coroutine();
+			}
+
+			void await_resume() noexcept
+			{
+
+			}
+		};
+
+		void Destroy()
+		{
+			if (m_handle)
+			{
+				m_handle.destroy();
+			}
+		}
+
+		std::coroutine_handle<promise_type> m_handle;
+	};
+
+	// co_await ReceiveAsync(source, cancellation): the next message of "source", or nullopt if a cancellation has been requested
+	// (that wins over pending data, like CancellableReceiver). If nothing is available, the coroutine is suspended without
+	// occupying a thread and it's resumed on the scheduler current when it suspended, as soon as a message (or the cancellation) arrives:
+	// - portable backend: the awaiter is registered as a waiter on both (as Concurrency::receive does)
+	// - ConcRT: the awaiter links a target to both, taking the first message offered
+	template<typename T>
+	class ReceiveAwaiter
+#if defined(PPLAGENTS_PORTABLE_BACKEND)
+		: Concurrency::Details::Waiter
+#endif
+	{
+	public:
+		ReceiveAwaiter(Concurrency::ISource<T>& source, CancellationToken& cancellation)
+			: m_source(source), m_cancellation(cancellation)
+		{
+
+		}
+
+		ReceiveAwaiter(const ReceiveAwaiter&) = delete;
+		ReceiveAwaiter& operator=(const ReceiveAwaiter&) = delete;
+
+		bool await_ready()
+		{
+			return TryComplete();
+		}
+
+#if defined(PPLAGENTS_PORTABLE_BACKEND)
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			m_handle = handle;
+			m_scheduler = &Concurrency::Scheduler::Current();
+			// owned by this attempt: a signal meanwhile doesn't schedule another one (see Signal)
+			m_signals.store(1, std::memory_order_relaxed);
+			m_source.register_waiter(this);
+			m_cancellation.m_target.register_waiter(this);
+			return !Attempt();
+		}
+
+		std::optional<T> await_resume()
+		{
+			return std::move(m_value);
+		}
+	private:
+		// called under the lock of the source
+		void Signal() override
+		{
+			if (m_signals.fetch_add(1, std::memory_order_acq_rel) == 0)
+			{
+				m_scheduler->Schedule([this] {
+					if (Attempt())
+					{
+						m_handle.resume();
+					}
+				});
+			}
+		}
+
+		// only one attempt at a time (the one that made m_signals positive): false if suspended again.
+		// Signals arriving meanwhile make the attempt retry instead of scheduling another one
+		bool Attempt()
+		{
+			auto seen = m_signals.load(std::memory_order_acquire);
+			while (!TryComplete())
+			{
+				if (m_signals.compare_exchange_strong(seen, 0, std::memory_order_acq_rel))
+				{
+					return false;
+				}
+			}
+			// no more signals after this: the awaiter can go
+			m_source.unregister_waiter(this);
+			m_cancellation.m_target.unregister_waiter(this);
+			return true;
+		}
+
+		Concurrency::Scheduler* m_scheduler = nullptr;
+		std::atomic<unsigned> m_signals = 0;
+#else
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			m_handle = handle;
+			m_scheduler = Concurrency::CurrentScheduler::Get();
+			m_linked = true;
+			m_cancellation.m_target.link_target(&m_cancellationTarget);
+			m_source.link_target(&m_dataTarget);
+			// a target might have fired while linking: then there's no need to suspend
+			return m_pending.fetch_sub(1, std::memory_order_acq_rel) != 1;
+		}
+
+		std::optional<T> await_resume()
+		{
+			// from here, not from propagate (a target is not unlinked while it's being offered a message)
+			if (m_linked)
+			{
+				m_source.unlink_target(&m_dataTarget);
+				m_cancellation.m_target.unlink_target(&m_cancellationTarget);
+			}
+			return std::move(m_value);
+		}
+	private:
+		// takes the first message offered to "Receiver" (if the awaiter has not fired yet)
+		template<typename U, typename Receiver>
+		class OneShotTarget : public Concurrency::ITarget<U>
+		{
+		public:
+			explicit OneShotTarget(ReceiveAwaiter& owner)
+				: m_owner(owner)
+			{
+
+			}
+
+			Concurrency::message_status propagate(Concurrency::message<U>* message, Concurrency::ISource<U>* source) override
+			{
+				return Receiver{}(m_owner, this, message, source);
+			}
+
+			Concurrency::message_status send(Concurrency::message<U>* message, Concurrency::ISource<U>* source) override
+			{
+				return Receiver{}(m_owner, this, message, source);
+			}
+
+			bool supports_anonymous_source() override
+			{
+				return true;
+			}
+		protected:
+			void link_source(Concurrency::ISource<U>*) override
+			{
+
+			}
+
+			void unlink_source(Concurrency::ISource<U>*) override
+			{
+
+			}
+
+			void unlink_sources() override
+			{
+
+			}
+		private:
+			ReceiveAwaiter& m_owner;
+		};
+
+		struct OfferData
+		{
+			Concurrency::message_status operator()(ReceiveAwaiter& owner, Concurrency::ITarget<T>* target, Concurrency::message<T>* message, Concurrency::ISource<T>* source) const
+			{
+				if (owner.m_fired.exchange(true, std::memory_order_acq_rel))
+				{
+					return Concurrency::declined;
+				}
+				auto* accepted = source ? source->accept(message->msg_id(), target) : message;
+				if (!accepted)
+				{
+					// taken by someone else: the cancellation might have been declined meanwhile
+					owner.m_fired.store(false, std::memory_order_release);
+					if (owner.m_cancellation.IsCancellationRequested() && !owner.m_fired.exchange(true, std::memory_order_acq_rel))
+					{
+						owner.Fired();
+					}
+					return Concurrency::missed;
+				}
+				owner.m_value.emplace(accepted->payload);
+				if (source)
+				{
+					delete accepted;
+				}
+				owner.Fired();
+				return Concurrency::accepted;
+			}
+		};
+
+		struct OfferCancellation
+		{
+			Concurrency::message_status operator()(ReceiveAwaiter& owner, Concurrency::ITarget<bool>* target, Concurrency::message<bool>* message, Concurrency::ISource<bool>* source) const
+			{
+				if (owner.m_fired.exchange(true, std::memory_order_acq_rel))
+				{
+					return Concurrency::declined;
+				}
+				// single_assignment hands over copies
+				if (source)
+				{
+					delete source->accept(message->msg_id(), target);
+				}
+				owner.Fired();
+				return Concurrency::accepted;
+			}
+		};
+
+		void Fired()
+		{
+			if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				m_scheduler->ScheduleTask([](void* address) {
+					std::coroutine_handle<>::from_address(address).resume();
+				}, m_handle.address());
+			}
+		}
+
+		Concurrency::Scheduler* m_scheduler = nullptr;
+		OneShotTarget<T, OfferData> m_dataTarget{ *this };
+		OneShotTarget<bool, OfferCancellation> m_cancellationTarget{ *this };
+		std::atomic<bool> m_fired = false;
+		std::atomic<int> m_pending = 2; // await_suspend and the target firing: the last one resumes
+		bool m_linked = false;
+#endif
+		// true if cancelled (m_value is empty) or a value has been taken
+		bool TryComplete()
+		{
+			if (m_cancellation.IsCancellationRequested())
+			{
+				m_value.reset();
+				return true;
+			}
+			T received{};
+			if (try_receive(m_source, received))
+			{
+				m_value.emplace(std::move(received));
+				return true;
+			}
+			return false;
+		}
+
+		Concurrency::ISource<T>& m_source;
+		CancellationToken& m_cancellation;
+		std::coroutine_handle<> m_handle;
+		std::optional<T> m_value;
+	};
+
+	template<typename T>
+	ReceiveAwaiter<T> ReceiveAsync(Concurrency::ISource<T>& source, CancellationToken& cancellation)
+	{
+		return ReceiveAwaiter<T>{ source, cancellation };
+	}
+
+	namespace Details
+	{
+		// runs the Task of a (deferred completion) Agent::Run, keeping what it needs after Run returns
+		class CoroutineRun
+		{
+		public:
+			// "start" creates the task from the token, "onDone" is called when it's finished (possibly before Start returns)
+			template<typename StartTask>
+			void Start(CancellationToken& cancellationToken, StartTask start, std::function<void()> onDone)
+			{
+				m_token.emplace(cancellationToken);
+				m_task = start(*m_token);
+				m_task.Start(std::move(onDone));
+			}
+		private:
+			std::optional<CancellationToken> m_token; // the one given to Run lives only until Run returns
+			Task m_task;
+		};
+	}
+
+	// An Agent whose work is a coroutine: RunAsync instead of Run.
+	// While RunAsync is suspended (e.g. in co_await ReceiveAsync), the agent occupies no thread, only the memory of its coroutine frame,
+	// so many mostly idle agents don't need as many threads. The agent is completed when RunAsync finishes
+	//
+	// struct MyAgent : CoroutineAgent
+	// {
+	// protected:
+	//    Task RunAsync(CancellationToken& cancellationToken) override
+	//    {
+	//       while (auto command = co_await ReceiveAsync(m_commands, cancellationToken))
+	//       {
+	//          ...
+	//       }
+	//    }
+	//
+	//    Concurrency::unbounded_buffer<Command> m_commands;
+	// };
+	//
+	// Started, stopped and waited like any other Agent (also with skills)
+	class CoroutineAgent : public Agent
+	{
+	protected:
+		virtual Task RunAsync(CancellationToken& cancellationToken) = 0;
+
+		void Run(CancellationToken& cancellationToken) final
+		{
+			// before starting: the task might finish (and complete the agent) right away
+			DeferCompletion();
+			m_run.Start(cancellationToken, [this](CancellationToken& token) {
+				return RunAsync(token);
+			}, [this] {
+				Complete();
+			});
+		}
+	private:
+		Details::CoroutineRun m_run;
+	};
+
+	// AsyncConsumerAgent as a coroutine: the same Consumer (with m_buffer and Consume), cancellation and LastMessagesPolicy,
+	// but receiving with co_await ReceiveAsync, so idle consumers don't occupy threads (see CoroutineAgent).
+	// Consume can also be a coroutine itself ("Task Consume(T)"), then it's co_awaited (also for the last values, taken one at a time
+	// with the Drain of LastMessagesPolicy, so that its budget bounds their consumption).
+	// If Consume throws, the agent stops and discards incoming messages, as AsyncConsumerAgent does.
+	// Batching, OnTick, ReceivePolicy and metrics are not supported (they are about how a thread waits), nor are skills with
+	// consume loop hooks (e.g. RateLimited, Recorded, TracedFlow: they would replace the coroutine loop with the blocking one,
+	// so composing them is a compile error). Skills without hooks (AutoStart, AutoStopAndWait, ...) apply as usual
+	//
+	// AgentComposer<CoroutineAsyncConsumerAgent<MyConsumer>, AutoStart, AutoStopAndWait> agent;
+	template<typename Consumer, typename LastMessagesPolicy = Skills::RetainLastValues>
+	class CoroutineAsyncConsumerAgent : public AsyncConsumerAgent<Consumer, LastMessagesPolicy>
+	{
+		using Base = AsyncConsumerAgent<Consumer, LastMessagesPolicy>;
+	public:
+		using Base::Base;
+
+		// see AgentComposer
+		static constexpr bool RejectsSkillHooks = true;
+	protected:
+		void Run(CancellationToken& cancellationToken) override
+		{
+			this->DeferCompletion();
+			m_run.Start(cancellationToken, [this](CancellationToken& token) {
+				return RunAsync(token);
+			}, [this] {
+				this->Complete();
+			});
+		}
+
+		Task RunAsync(CancellationToken& cancellationToken)
+		{
+			try
+			{
+				co_await ConsumeUntilCancelledAsync(cancellationToken);
+				co_await ProcessLastValuesAsync();
+			}
+			catch (const std::exception&)
+			{
+				m_failed = true;
+			}
+			// co_await is not allowed in a handler, nor is it needed here
+			if (m_failed)
+			{
+				this->DiscardIncomingMessages();
+			}
+		}
+
+		Task ConsumeUntilCancelledAsync(CancellationToken& cancellationToken)
+		{
+			while (auto received = co_await ReceiveAsync(this->m_buffer, cancellationToken))
+			{
+				if constexpr (ConsumeIsAsync<CoroutineAsyncConsumerAgent>())
+				{
+					co_await this->Consume(Utils::Unwrap(std::move(*received)));
+				}
+				else
+				{
+					this->Consume(Utils::Unwrap(std::move(*received)));
+				}
+			}
+		}
+
+		Task ProcessLastValuesAsync()
+		{
+			if constexpr (ConsumeIsAsync<CoroutineAsyncConsumerAgent>())
+			{
+				using Buffer = std::remove_reference_t<decltype(this->m_buffer)>;
+				if constexpr (Details::HasDrain<LastMessagesPolicy, Buffer>::value)
+				{
+					// one value at a time: a budget (e.g. BoundedDrain) is checked between co_awaits, so it bounds the consumption
+					typename LastMessagesPolicy::template Drain<Buffer> drain{ this->m_buffer };
+					payloadType value{};
+					while (drain.TryTake(value))
+					{
+						co_await this->Consume(Utils::Unwrap(std::move(value)));
+					}
+					drain.Finish();
+				}
+				else
+				{
+					static_assert(!Details::HasBudget<LastMessagesPolicy>::value, "A budgeted LastMessagesPolicy needs a Drain to bound an async Consume");
+					// the policy takes them (e.g. CoalesceLastValues, that keeps one per key), then each one is co_awaited
+					std::vector<payloadType> values;
+					LastMessagesPolicy::Process(this->m_buffer, [&](auto&& value) {
+						values.push_back(std::forward<decltype(value)>(value));
+					});
+					for (auto& value : values)
+					{
+						co_await this->Consume(Utils::Unwrap(std::move(value)));
+					}
+				}
+			}
+			else
+			{
+				this->ProcessLastValues();
+			}
+		}
+	private:
+		using payloadType = decltype(Utils::detect(CoroutineAsyncConsumerAgent::m_buffer));
+
+		// Consumer members might be protected, so detection happens here (where they are accessible)
+		template<typename Self>
+		static constexpr bool ConsumeIsAsync()
+		{
+			return std::is_same_v<decltype(std::declval<Self&>().Consume(Utils::Unwrap(std::declval<payloadType>()))), Task>;
+		}
+
+		Details::CoroutineRun m_run;
+		bool m_failed = false;
+	};
+}
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include "Backend.h"
+
+namespace Agents
+{
+	// A target that takes every message offered and destroys it right away, counting how many (a "null consumer").
+	// Lock-free (just an atomic increment) and nothing is stored, so large payloads are freed immediately.
+	// Whoever links it to a source has to unlink it before destroying it.
+	//
+	// DiscardTarget<int> discard;
+	// buffer.link_target(&discard);
+	// ...
+	// buffer.unlink_target(&discard);
+	// auto dropped = discard.Dropped();
+	//
+	template<typename T>
+	class DiscardTarget : public Concurrency::ITarget<T>
+	{
+	public:
+		DiscardTarget() = default;
+		DiscardTarget(const DiscardTarget&) = delete;
+		DiscardTarget& operator=(const DiscardTarget&) = delete;
+
+		Concurrency::message_status propagate(Concurrency::message<T>* message, Concurrency::ISource<T>* source) override
+		{
+			return Discard(message, source);
+		}
+
+		Concurrency::message_status send(Concurrency::message<T>* message, Concurrency::ISource<T>* source) override
+		{
+			return Discard(message, source);
+		}
+
+		bool supports_anonymous_source() override
+		{
+			return true;
+		}
+
+		[[nodiscard]] uint64_t Dropped() const
+		{
+			return m_dropped.load(std::memory_order_relaxed);
+		}
+	protected:
+		void link_source(Concurrency::ISource<T>*) override
+		{
+
+		}
+
+		void unlink_source(Concurrency::ISource<T>*) override
+		{
+
+		}
+
+		void unlink_sources() override
+		{
+
+		}
+	private:
+		Concurrency::message_status Discard(Concurrency::message<T>* message, Concurrency::ISource<T>* source)
+		{
+			if (source)
+			{
+				message = source->accept(message->msg_id(), this);
+				if (!message)
+				{
+					return Concurrency::missed; // someone else took it
+				}
+			}
+			delete message; // accepted messages are owned by the target
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return Concurrency::accepted;
+		}
+
+		std::atomic<uint64_t> m_dropped = 0;
+	};
+}
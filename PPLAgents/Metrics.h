@@ -0,0 +1,146 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "Agent.h"
+#include "AgentComposer.h"
+
+namespace Agents
+{
+	namespace Details
+	{
+		inline unsigned Log2(uint64_t value) noexcept
+		{
+#if defined(_MSC_VER)
+			unsigned long index = 0;
+			return _BitScanReverse64(&index, value) ? static_cast<unsigned>(index) : 0;
+#else
+			return value ? 63u - static_cast<unsigned>(__builtin_clzll(value)) : 0;
+#endif
+		}
+	}
+
+	// point-in-time view of AgentMetrics
+	struct MetricsSnapshot
+	{
+		// bucket i counts Consume calls that took [2^i, 2^(i+1)) nanoseconds
+		static constexpr size_t HistogramBuckets = 40;
+
+		uint64_t MessagesProcessed = 0;
+		uint64_t ConsumeCalls = 0;
+		std::chrono::nanoseconds ConsumeTime{};
+		std::chrono::nanoseconds ReceiveWaitTime{};
+		uint64_t MessagesDropped = 0; // discarded after Consume has thrown
+		std::optional<size_t> Pending; // only if the buffer can tell (e.g. BoundedBuffer)
+		std::array<uint64_t, HistogramBuckets> ConsumeLatencyHistogram{};
+
+		// upper bound of the bucket containing the requested percentile (e.g. 0.99) of Consume latency
+		[[nodiscard]] std::chrono::nanoseconds ConsumeLatencyPercentile(double percentile) const
+		{
+			const auto target = static_cast<uint64_t>(percentile * ConsumeCalls);
+			uint64_t seen = 0;
+			for (size_t i = 0; i < HistogramBuckets; ++i)
+			{
+				seen += ConsumeLatencyHistogram[i];
+				if (seen > target)
+				{
+					return std::chrono::nanoseconds{ 1ll << (i + 1) };
+				}
+			}
+			return std::chrono::nanoseconds{ ConsumeCalls ? 1ll << HistogramBuckets : 0 };
+		}
+	};
+
+	// Counters recorded by an AsyncConsumerAgent while it runs.
+	// - it occupies its own cache lines, so instrumenting many agents does not cause false sharing
+	// - updates are relaxed atomic increments, reads (Snapshot) can happen from any thread at any time
+	class alignas(64) AgentMetrics
+	{
+	public:
+		void AddReceiveWait(std::chrono::nanoseconds wait) noexcept
+		{
+			m_receiveWaitTime.fetch_add(wait.count(), std::memory_order_relaxed);
+		}
+
+		void AddConsumed(size_t messages, std::chrono::nanoseconds duration) noexcept
+		{
+			m_messagesProcessed.fetch_add(messages, std::memory_order_relaxed);
+			m_consumeCalls.fetch_add(1, std::memory_order_relaxed);
+			m_consumeTime.fetch_add(duration.count(), std::memory_order_relaxed);
+			const auto bucket = Details::Log2(static_cast<uint64_t>(duration.count()));
+			m_histogram[bucket < MetricsSnapshot::HistogramBuckets ? bucket : MetricsSnapshot::HistogramBuckets - 1].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] MetricsSnapshot Snapshot() const noexcept
+		{
+			MetricsSnapshot snapshot;
+			snapshot.MessagesProcessed = m_messagesProcessed.load(std::memory_order_relaxed);
+			snapshot.ConsumeCalls = m_consumeCalls.load(std::memory_order_relaxed);
+			snapshot.ConsumeTime = std::chrono::nanoseconds{ m_consumeTime.load(std::memory_order_relaxed) };
+			snapshot.ReceiveWaitTime = std::chrono::nanoseconds{ m_receiveWaitTime.load(std::memory_order_relaxed) };
+			for (size_t i = 0; i < MetricsSnapshot::HistogramBuckets; ++i)
+			{
+				snapshot.ConsumeLatencyHistogram[i] = m_histogram[i].load(std::memory_order_relaxed);
+			}
+			return snapshot;
+		}
+	private:
+		std::atomic<uint64_t> m_messagesProcessed = 0;
+		std::atomic<uint64_t> m_consumeCalls = 0;
+		std::atomic<long long> m_consumeTime = 0;
+		std::atomic<long long> m_receiveWaitTime = 0;
+		std::array<std::atomic<uint64_t>, MetricsSnapshot::HistogramBuckets> m_histogram{};
+	};
+
+	namespace Skills
+	{
+		// records AgentMetrics of an AsyncConsumerAgent (place it before stop and wait skills, AgentComposer checks it):
+		// AgentComposer<AsyncConsumerAgent<MyConsumer>, Instrumented, AutoStart, AutoStopAndWait> agent{ buffer };
+		// ...
+		// auto metrics = agent.Metrics(); // from any thread, while the agent runs
+		// Recording starts once the whole agent is constructed (see OnComposed), so place it before AutoStart to record from the start.
+		// On destruction, an agent still running (e.g. ManualWait not called) is stopped and waited: its loop must not outlive m_metrics
+		template<typename T>
+		struct Instrumented
+		{
+			void OnComposed()
+			{
+				static_cast<T&>(*this).AttachMetrics(&m_metrics);
+			}
+
+			~Instrumented()
+			{
+				auto& agent = static_cast<T&>(*this);
+				const auto status = agent.Status();
+				if (status != AgentStatus::Created && status != AgentStatus::Waited)
+				{
+					agent.StopAndWait();
+				}
+				agent.AttachMetrics(nullptr);
+			}
+
+			[[nodiscard]] MetricsSnapshot Metrics()
+			{
+				auto snapshot = m_metrics.Snapshot();
+				snapshot.MessagesDropped = static_cast<T&>(*this).DroppedMessages();
+				auto& buffer = static_cast<T&>(*this).Buffer();
+				if constexpr (Details::HasSize<std::remove_reference_t<decltype(buffer)>>::value)
+				{
+					snapshot.Pending = buffer.Size();
+				}
+				return snapshot;
+			}
+		private:
+			AgentMetrics m_metrics;
+		};
+
+		template<> struct SkillTraits<Instrumented> : SkillTraitsOf<Decides::Nothing, Decides::Nothing, true> {};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,158 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "ParallelAsyncConsumer.h"
+#include "StrategyBasedAsyncConsumer.h"
+
+namespace Agents
+{
+	// A consume strategy that transforms messages in parallel and still publishes the results in the order messages arrived.
+	//
+	// - each message gets a sequence number and it's sent to a pool of "DegreeOfParallelism" workers (a ParallelAsyncConsumerAgent)
+	// - a reorder stage publishes the results to "output" in sequence order
+	// - at most "window" messages can be in flight (being transformed or waiting for a previous one):
+	//   when the window is full, Consume blocks until the oldest message has been published (memory stays capped if one is slow)
+	// - if "transform" throws, that message is skipped (not published) and counted in Failures()
+	//
+	// Concurrency::unbounded_buffer<std::string> results;
+	// auto strategy = std::make_unique<OrderedParallelStrategy<int, std::string, 4>>([](const int& i) {
+	//    return ExpensiveFormat(i);
+	// }, results, 128);
+	// StrategyBasedAsyncConsumer<int> consumer{ numbers, std::move(strategy) };
+	// // results receives the strings in the same order numbers received the ints
+	//
+	template<typename T, typename R, size_t DegreeOfParallelism = 4>
+	class OrderedParallelStrategy : public IAsyncConsumerStrategy<T>
+	{
+	public:
+		OrderedParallelStrategy(std::function<R(const T&)> transform, Concurrency::ITarget<R>& output, size_t window)
+			: m_transform(std::move(transform)), m_output(output), m_pending((std::max)(window, size_t{ 1 })), m_workers(*this)
+		{
+			for (size_t i = 0; i < m_pending.size(); ++i)
+			{
+				asend(m_slots, true);
+			}
+		}
+
+		void Consume(const T& value) override
+		{
+			receive(m_slots); // waits while the reorder window is full
+			send(m_work, WorkItem{ m_nextSequence++, value });
+		}
+
+		[[nodiscard]] size_t Failures() const
+		{
+			return m_failures.load(std::memory_order_relaxed);
+		}
+	private:
+		using WorkItem = std::pair<size_t, T>;
+
+		struct Slot
+		{
+			bool completed = false;
+			std::optional<R> result;
+		};
+
+		class Worker
+		{
+		public:
+			explicit Worker(OrderedParallelStrategy& parent)
+				: m_buffer(parent.m_work), m_parent(parent)
+			{
+
+			}
+		protected:
+			void Consume(const WorkItem& item)
+			{
+				std::optional<R> result;
+				try
+				{
+					result = m_parent.m_transform(item.second);
+				}
+				catch (const std::exception&)
+				{
+					m_parent.m_failures.fetch_add(1, std::memory_order_relaxed);
+				}
+				m_parent.Complete(item.first, std::move(result));
+			}
+
+			Concurrency::ISource<WorkItem>& m_buffer;
+		private:
+			OrderedParallelStrategy& m_parent;
+		};
+
+		// stores the result of "sequence" and, unless another worker is publishing, publishes all the consecutive results that are ready
+		void Complete(size_t sequence, std::optional<R> result)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_reorderMutex);
+				auto& slot = m_pending[sequence % m_pending.size()];
+				slot.completed = true;
+				slot.result = std::move(result);
+				if (m_publishing)
+				{
+					return; // the publishing worker finds it before giving up the role
+				}
+				m_publishing = true;
+			}
+			Publish();
+		}
+
+		// one worker at a time (the one setting m_publishing): results are taken in order under the lock and sent after releasing it,
+		// so the other workers don't wait for the propagation to m_output
+		void Publish()
+		{
+			while (true)
+			{
+				size_t published = 0;
+				{
+					std::lock_guard<std::mutex> lock(m_reorderMutex);
+					for (auto* next = &m_pending[m_nextToPublish % m_pending.size()]; next->completed; next = &m_pending[m_nextToPublish % m_pending.size()])
+					{
+						if (next->result)
+						{
+							m_ready.push_back(std::move(*next->result));
+						}
+						*next = Slot{};
+						++m_nextToPublish;
+						++published;
+					}
+					if (published == 0)
+					{
+						m_publishing = false;
+						return;
+					}
+				}
+				for (auto& ready : m_ready)
+				{
+					send(m_output, std::move(ready));
+				}
+				m_ready.clear();
+				// the window is released only once they are published
+				for (; published > 0; --published)
+				{
+					asend(m_slots, true);
+				}
+			}
+		}
+
+		std::function<R(const T&)> m_transform;
+		Concurrency::ITarget<R>& m_output;
+		Concurrency::unbounded_buffer<bool> m_slots;
+		Concurrency::unbounded_buffer<WorkItem> m_work;
+		size_t m_nextSequence = 0; // only touched by Consume
+		std::mutex m_reorderMutex;
+		std::vector<Slot> m_pending;
+		size_t m_nextToPublish = 0;
+		bool m_publishing = false; // guarded by m_reorderMutex
+		std::vector<R> m_ready; // only touched by the publishing worker
+		std::atomic<size_t> m_failures = 0;
+		// last, so it's stopped (after processing all the pending work) before anything else is destroyed
+		ParallelAsyncConsumer<Worker, DegreeOfParallelism, Skills::AutoStart, Skills::AutoStop, Skills::AutoWait, Skills::RetainLastValues> m_workers;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "AsyncConsumer.h"
+
+namespace Agents
+{
+	namespace Details
+	{
+		// runs "work" on "degreeOfParallelism" contexts (the calling one included) and waits for all of them.
+		// "work" is expected not to throw
+		template<typename Work>
+		void RunOnWorkers(size_t degreeOfParallelism, Work& work)
+		{
+			class Worker : public Concurrency::agent
+			{
+			public:
+				explicit Worker(Work& work)
+					: m_work(work)
+				{
+
+				}
+			protected:
+				void run() override
+				{
+					Utils::defer doneGuard([this] { done(); });
+					m_work();
+				}
+			private:
+				Work& m_work;
+			};
+
+			std::vector<std::unique_ptr<Worker>> workers;
+			workers.reserve(degreeOfParallelism - 1);
+			Utils::defer waitGuard([&] {
+				for (auto& worker : workers)
+				{
+					Concurrency::agent::wait(worker.get());
+				}
+			});
+			for (size_t i = 1; i < degreeOfParallelism; ++i)
+			{
+				workers.push_back(std::make_unique<Worker>(work));
+				workers.back()->start();
+			}
+			work();
+		}
+	}
+
+	// An AsyncConsumerAgent running "DegreeOfParallelism" consumer loops on the same m_buffer.
+	// It's still one Agent: one CancellationTokenSource controls all the loops and Start/Stop/Wait act on the whole group.
+	//
+	// - Consume (or ConsumeBatch) is called concurrently, so it must be thread-safe
+	// - OnTick is not supported (it would run on every loop, concurrently with the others' Consume): a Consumer having it doesn't compile
+	// - when a loop loses a message to another one (the choice::has_value() == false case), it just goes back to (blocking) receive
+	// - last values are processed once (LastMessagesPolicy runs on one loop, so its budget, e.g. BoundedDrain, is the agent's),
+	//   after all the loops have seen the cancellation and exited
+	// - if any Consume throws, the whole group is stopped, last values are not processed and m_buffer is linked to the agent DiscardTarget
+	//
+	// ParallelAsyncConsumerAgent<MyConsumer, 4> agent{ buffer };
+	// agent.Start();
+	// ...
+	// agent.StopAndWait(); // stops and waits all the 4 loops
+	//
+	template<typename Consumer, size_t DegreeOfParallelism, typename LastMessagesPolicy = Skills::RetainLastValues, typename ReceivePolicy = Skills::BlockingReceive>
+	class ParallelAsyncConsumerAgent : public AsyncConsumerAgent<Consumer, LastMessagesPolicy, ReceivePolicy>
+	{
+		static_assert(DegreeOfParallelism > 0, "DegreeOfParallelism must be positive");
+		using Base = AsyncConsumerAgent<Consumer, LastMessagesPolicy, ReceivePolicy>;
+	public:
+		using Base::Base;
+	protected:
+		void Run(CancellationToken& cancellationToken) override
+		{
+			Details::NoHooks hooks;
+			RunWithHooks(cancellationToken, hooks);
+		}
+
+		// Run calling "hooks" (see AgentComposer), from all the loops
+		template<typename Hooks>
+		void RunWithHooks(CancellationToken& cancellationToken, Hooks& hooks)
+		{
+			static_assert(!HasTick<ParallelAsyncConsumerAgent>(0), "OnTick is not supported by ParallelAsyncConsumerAgent: use an AsyncConsumerAgent (or a separate agent) for periodic work");
+			std::atomic<bool> failed = false;
+
+			auto consumeLoop = [&] {
+				try
+				{
+					this->ConsumeUntilCancelled(cancellationToken, hooks);
+				}
+				catch (const std::exception&)
+				{
+					failed = true;
+					this->Stop(); // the other loops are waiting on the same token
+				}
+			};
+			Details::RunOnWorkers(DegreeOfParallelism, consumeLoop);
+
+			if (!failed)
+			{
+				try
+				{
+					this->ProcessLastValues(hooks);
+				}
+				catch (const std::exception&)
+				{
+					failed = true;
+				}
+			}
+
+			if (failed)
+			{
+				this->DiscardIncomingMessages();
+			}
+		}
+	private:
+		// Consumer members might be protected, so detection happens here (where they are accessible)
+		template<typename Self>
+		static constexpr auto HasTick(int) -> decltype(std::declval<Self&>().OnTick(), bool())
+		{
+			return true;
+		}
+
+		template<typename Self>
+		static constexpr bool HasTick(...)
+		{
+			return false;
+		}
+	};
+
+	// same as AsyncConsumer but using ParallelAsyncConsumerAgent
+	// Examples:
+	// using FourWorkersConsumer = ParallelAsyncConsumer<MyConsumer, 4, AutoStart, AutoStop, AutoWait, RetainLastValues>
+	template<typename Consumer, size_t DegreeOfParallelism, template <typename> typename StartPolicy, template <typename> typename StopPolicy, template <typename> typename WaitPolicy, typename LastValuesPolicy, typename ReceivePolicy = Skills::BlockingReceive>
+	using ParallelAsyncConsumer = AgentComposer<ParallelAsyncConsumerAgent<Consumer, DegreeOfParallelism, LastValuesPolicy, ReceivePolicy>, StartPolicy, WaitPolicy, StopPolicy>;
+}
\ No newline at end of file
@@ -0,0 +1,184 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "BoundedBuffer.h"
+#include "ParallelAsyncConsumer.h"
+
+namespace Agents
+{
+	// Per-key ordering with more than one consumer loop: each message goes to one of "Shards" buffers, chosen by hashing KeyOf()(message),
+	// and each shard is consumed by its own AsyncConsumerAgent loop. Messages with the same key are consumed in order, by the same loop.
+	// It's still one Agent: one CancellationTokenSource controls all the loops and Start/Stop/Wait act on the whole group.
+	//
+	// The Consumer has no m_buffer (the agent owns one per shard) and only Consume is supported:
+	//
+	// class Ledger
+	// {
+	// protected:
+	//    void Consume(const Trade& trade); // called concurrently for different shards (one shard at a time per key)
+	// };
+	//
+	// struct ByAccount
+	// {
+	//    int operator()(const Trade& trade) const { return trade.Account; }
+	// };
+	//
+	// PartitionedAsyncConsumerAgent<Ledger, Trade, 8, ByAccount> ledger;
+	// ledger.Start();
+	// ledger.Send(trade); // or send(ledger.ShardOf(trade), trade)
+	// ...
+	// ledger.StopAndWait();
+	//
+	// - routing takes no lock: the key is hashed on the sender and the message is sent to the shard buffer (that only its loop receives from)
+	// - shard buffers are unbounded BoundedBuffers: the drain of last values seals them, so Send returns false from then on
+	// - last values are processed per shard, by all the loops in parallel, after all of them have seen the cancellation. The budget of
+	//   LastMessagesPolicy is split among the shards (e.g. BoundedDrain<500, 1000> drains at most 1000 / Shards messages per shard, all within 500 ms)
+	// - if any Consume throws, the whole group is stopped, last values are not processed and every shard buffer is linked to a DiscardTarget
+	template<typename Consumer, typename T, size_t Shards, typename KeyOf, typename LastMessagesPolicy = Skills::RetainLastValues, typename ReceivePolicy = Skills::BlockingReceive>
+	class PartitionedAsyncConsumerAgent : public Consumer, public Agent
+	{
+		static_assert(Shards > 0, "Shards must be positive");
+	public:
+		using Consumer::Consumer;
+
+		// the buffer receiving "value" (always the same for the same key)
+		Concurrency::ITarget<T>& ShardOf(const T& value)
+		{
+			return m_shards[ShardIndex(value)]->Buffer();
+		}
+
+		bool Send(const T& value)
+		{
+			return send(ShardOf(value), value);
+		}
+
+		// messages discarded (by all the shards) after Consume has thrown
+		[[nodiscard]] uint64_t DroppedMessages() const
+		{
+			uint64_t dropped = 0;
+			for (const auto& shard : m_shards)
+			{
+				dropped += shard->DroppedMessages();
+			}
+			return dropped;
+		}
+	protected:
+		void Run(CancellationToken& cancellationToken) override
+		{
+			Details::NoHooks hooks;
+			RunWithHooks(cancellationToken, hooks);
+		}
+
+		// Run calling "hooks" (see AgentComposer), from all the loops
+		template<typename Hooks>
+		void RunWithHooks(CancellationToken& cancellationToken, Hooks& hooks)
+		{
+			std::atomic<bool> failed = false;
+			std::atomic<size_t> nextShard = 0; // each loop takes a shard
+
+			auto consumeLoop = [&] {
+				try
+				{
+					m_shards[nextShard++]->ConsumeUntilCancelled(cancellationToken, hooks);
+				}
+				catch (const std::exception&)
+				{
+					failed = true;
+					this->Stop(); // the other loops are waiting on the same token
+				}
+			};
+			Details::RunOnWorkers(Shards, consumeLoop);
+
+			if (!failed)
+			{
+				nextShard = 0;
+				auto lastValuesLoop = [&] {
+					try
+					{
+						m_shards[nextShard++]->ProcessLastValues(hooks);
+					}
+					catch (const std::exception&)
+					{
+						failed = true;
+					}
+				};
+				Details::RunOnWorkers(Shards, lastValuesLoop);
+			}
+
+			if (failed)
+			{
+				for (auto& shard : m_shards)
+				{
+					shard->DiscardIncomingMessages();
+				}
+			}
+		}
+	private:
+		// the Consumer of one shard: its own buffer, Consume forwarded to the agent
+		class ShardConsumer
+		{
+		public:
+			explicit ShardConsumer(PartitionedAsyncConsumerAgent& agent)
+				: m_agent(agent)
+			{
+
+			}
+		protected:
+			// the shard has already unwrapped the value (see Utils::Movable)
+			template<typename U>
+			void Consume(U&& value)
+			{
+				m_agent.Consume(std::forward<U>(value));
+			}
+
+			BoundedBuffer<T> m_buffer; // no capacity, only to be sealed and sized by the drain (see Details::SealBacklog)
+		private:
+			PartitionedAsyncConsumerAgent& m_agent;
+		};
+
+		// never started: its loops run on the workers of this agent, with its token (and are traced as this agent)
+		class Shard : public AsyncConsumerAgent<ShardConsumer, Details::SplitLastValuesPolicy<LastMessagesPolicy, Shards>, ReceivePolicy>
+		{
+			using Base = AsyncConsumerAgent<ShardConsumer, Details::SplitLastValuesPolicy<LastMessagesPolicy, Shards>, ReceivePolicy>;
+		public:
+			explicit Shard(PartitionedAsyncConsumerAgent& agent)
+				: Base(agent)
+			{
+				this->TraceAs(agent);
+			}
+
+			using Base::ConsumeUntilCancelled;
+			using Base::ProcessLastValues;
+			using Base::DiscardIncomingMessages;
+		};
+
+		size_t ShardIndex(const T& value) const
+		{
+			using Key = std::decay_t<std::invoke_result_t<const KeyOf&, const T&>>;
+			return std::hash<Key>{}(m_keyOf(value)) % Shards;
+		}
+
+		std::array<std::unique_ptr<Shard>, Shards> MakeShards()
+		{
+			std::array<std::unique_ptr<Shard>, Shards> shards;
+			for (auto& shard : shards)
+			{
+				shard = std::make_unique<Shard>(*this);
+			}
+			return shards;
+		}
+
+		KeyOf m_keyOf;
+		std::array<std::unique_ptr<Shard>, Shards> m_shards = MakeShards();
+	};
+
+	// same as AsyncConsumer but using PartitionedAsyncConsumerAgent
+	// Examples:
+	// using Ledgers = PartitionedAsyncConsumer<Ledger, Trade, 8, ByAccount, AutoStart, AutoStop, AutoWait, RetainLastValues>
+	template<typename Consumer, typename T, size_t Shards, typename KeyOf, template <typename> typename StartPolicy, template <typename> typename StopPolicy, template <typename> typename WaitPolicy, typename LastValuesPolicy, typename ReceivePolicy = Skills::BlockingReceive>
+	using PartitionedAsyncConsumer = AgentComposer<PartitionedAsyncConsumerAgent<Consumer, T, Shards, KeyOf, LastValuesPolicy, ReceivePolicy>, StartPolicy, WaitPolicy, StopPolicy>;
+}
@@ -0,0 +1,403 @@
+#pragma once
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "BoundedBuffer.h"
+#include "ParallelAsyncConsumer.h"
+
+namespace Agents
+{
+	// Builds a chain of AsyncConsumer stages without wiring buffers by hand.
+	//
+	// Pipeline<int> pipeline{ 1024 }; // capacity of the input
+	// pipeline.From()
+	//    .Filter([](int i) { return i % 2 == 0; })
+	//    .Stage<4>(256) // from here, 4 consumers reading from a buffer of capacity 256
+	//    .Transform([](int i) { return Expensive(i); })
+	//    .Batch<32>(256) // from here, batches of (at most) 32 results
+	//    .ForEach([](const std::vector<Result>& batch) { Store(batch); });
+	// pipeline.Start();
+	// Send(pipeline.Input(), 42);
+	// ...
+	// pipeline.StopAndWait();
+	//
+	// - a stage is an agent (ParallelAsyncConsumerAgent) consuming from its own BoundedBuffer:
+	//   Transform, Filter and ForEach are fused into the current stage (no queue hop), only Stage, Batch and FanOut start a new one
+	// - messages are passed between stages with Agents::Send, so a full stage (its capacity) slows down the one before
+	// - Start starts the stages from the tail, StopAndWait stops and waits them from the head, each one processing its last values
+	//   (RetainLastValues) before the next is stopped: everything sent before StopAndWait reaches the tail
+	// - functions of a stage with more than one consumer are called concurrently (and messages can be reordered)
+	// - FanOut sends a copy of each message to every branch. If branches return their Flow, results are merged (fan-in) into a new stage.
+	//   Pipeline::Input() can be fed by any number of producers (or linked sources), too
+	// - every Flow must be terminated (ForEach, To or FanOut), otherwise its last stage is never created
+	//
+	template<typename In>
+	class Pipeline;
+
+	namespace Details
+	{
+		class IPipelineStage
+		{
+		public:
+			virtual ~IPipelineStage() = default;
+			virtual void Start() = 0;
+			virtual void StopAndWait() = 0;
+		};
+
+		template<typename StageAgent>
+		class PipelineStage : public IPipelineStage
+		{
+		public:
+			template<typename... Args>
+			explicit PipelineStage(Args&&... args)
+				: m_agent(std::forward<Args>(args)...)
+			{
+
+			}
+
+			void Start() override
+			{
+				m_agent.Start();
+			}
+
+			void StopAndWait() override
+			{
+				m_agent.StopAndWait();
+			}
+		private:
+			StageAgent m_agent;
+		};
+
+		// stages in dependency order (a stage is always created after the ones sending to it) and the buffers between them
+		class PipelineGraph
+		{
+		public:
+			template<typename T>
+			BoundedBuffer<T>& AddBuffer(size_t capacity)
+			{
+				auto buffer = std::make_shared<BoundedBuffer<T>>(capacity);
+				m_buffers.push_back(buffer);
+				return *buffer;
+			}
+
+			template<typename StageAgent, typename... Args>
+			void AddStage(Args&&... args)
+			{
+				m_stages.push_back(std::make_unique<PipelineStage<StageAgent>>(std::forward<Args>(args)...));
+			}
+
+			void Start()
+			{
+				for (auto it = m_stages.rbegin(); it != m_stages.rend(); ++it)
+				{
+					(*it)->Start();
+				}
+			}
+
+			void StopAndWait()
+			{
+				for (auto& stage : m_stages)
+				{
+					stage->StopAndWait();
+				}
+			}
+		private:
+			std::vector<std::shared_ptr<void>> m_buffers; // declared first: stages are destroyed before
+			std::vector<std::unique_ptr<IPipelineStage>> m_stages;
+		};
+
+		// the Consumer of a stage: each message goes through the fused functions ("chain")
+		template<typename T, typename Chain>
+		class StageConsumer
+		{
+		public:
+			StageConsumer(BoundedBuffer<T>& buffer, Chain chain)
+				: m_buffer(buffer), m_chain(std::move(chain))
+			{
+
+			}
+		protected:
+			void Consume(T&& value)
+			{
+				m_chain(std::move(value));
+			}
+
+			BoundedBuffer<T>& m_buffer;
+		private:
+			Chain m_chain;
+		};
+
+		// like StageConsumer but the chain receives batches (see AsyncConsumerAgent batching)
+		template<typename T, typename Chain, size_t BatchSize, unsigned BatchLatency>
+		class BatchStageConsumer
+		{
+		public:
+			static constexpr size_t MaxBatchSize = BatchSize;
+			static constexpr unsigned MaxBatchLatency = BatchLatency;
+
+			BatchStageConsumer(BoundedBuffer<T>& buffer, Chain chain)
+				: m_buffer(buffer), m_chain(std::move(chain))
+			{
+
+			}
+		protected:
+			void ConsumeBatch(Utils::span<T> batch)
+			{
+				m_chain(std::vector<T>(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end())));
+			}
+
+			BoundedBuffer<T>& m_buffer;
+		private:
+			Chain m_chain;
+		};
+
+		template<size_t DegreeOfParallelism>
+		struct ParallelStage
+		{
+			template<typename T, typename Chain>
+			using Agent = ParallelAsyncConsumer<StageConsumer<T, Chain>, DegreeOfParallelism, Skills::ManualStart, Skills::ManualStop, Skills::ManualWait, Skills::RetainLastValues>;
+		};
+
+		template<size_t BatchSize, unsigned BatchLatency, size_t DegreeOfParallelism>
+		struct BatchStage
+		{
+			template<typename T, typename Chain>
+			using Agent = ParallelAsyncConsumer<BatchStageConsumer<T, Chain, BatchSize, BatchLatency>, DegreeOfParallelism, Skills::ManualStart, Skills::ManualStop, Skills::ManualWait, Skills::RetainLastValues>;
+		};
+
+		// fused functions: each one binds to the "next" (the rest of the chain) producing a callable for one value
+
+		template<typename F>
+		struct TransformOp
+		{
+			template<typename Next>
+			auto Bind(Next next) const
+			{
+				return [f = m_f, next = std::move(next)](auto&& value) mutable {
+					next(f(std::forward<decltype(value)>(value)));
+				};
+			}
+
+			F m_f;
+		};
+
+		template<typename F>
+		struct FilterOp
+		{
+			template<typename Next>
+			auto Bind(Next next) const
+			{
+				return [f = m_f, next = std::move(next)](auto&& value) mutable {
+					if (f(std::as_const(value)))
+					{
+						next(std::forward<decltype(value)>(value));
+					}
+				};
+			}
+
+			F m_f;
+		};
+	}
+
+	// The stream of T flowing in a stage of a Pipeline (whose buffer contains StageInput) after some fused functions (Ops).
+	// Created by Pipeline::From, each function returns the next Flow
+	template<typename StageInput, typename T, typename StageKind, typename... Ops>
+	class Flow
+	{
+	public:
+		using value_type = T;
+
+		// fused: "f(value)" goes on
+		template<typename F>
+		[[nodiscard]] auto Transform(F f) const
+		{
+			using Result = std::decay_t<std::invoke_result_t<F&, T&&>>;
+			static_assert(!std::is_void_v<Result>, "Transform must return a value (use ForEach to terminate the Flow)");
+			return Flow<StageInput, Result, StageKind, Ops..., Details::TransformOp<F>>{ *m_graph, *m_source, std::tuple_cat(m_ops, std::make_tuple(Details::TransformOp<F>{ std::move(f) })) };
+		}
+
+		// fused: only values for which "predicate(value)" is true go on
+		template<typename Predicate>
+		[[nodiscard]] auto Filter(Predicate predicate) const
+		{
+			return Flow<StageInput, T, StageKind, Ops..., Details::FilterOp<Predicate>>{ *m_graph, *m_source, std::tuple_cat(m_ops, std::make_tuple(Details::FilterOp<Predicate>{ std::move(predicate) })) };
+		}
+
+		// new stage: "DegreeOfParallelism" consumers reading from a buffer of "capacity" messages
+		template<size_t DegreeOfParallelism = 1>
+		[[nodiscard]] Flow<T, T, Details::ParallelStage<DegreeOfParallelism>> Stage(size_t capacity = (std::numeric_limits<size_t>::max)()) const
+		{
+			auto& next = m_graph->AddBuffer<T>(capacity);
+			To(next);
+			return { *m_graph, next, {} };
+		}
+
+		// new stage: values go on in batches (std::vector<T>) of at most "MaxBatchSize" values,
+		// waiting at most "MaxBatchLatency" milliseconds for a batch to fill up (see AsyncConsumerAgent batching)
+		template<size_t MaxBatchSize, unsigned MaxBatchLatency = 0, size_t DegreeOfParallelism = 1>
+		[[nodiscard]] Flow<T, std::vector<T>, Details::BatchStage<MaxBatchSize, MaxBatchLatency, DegreeOfParallelism>> Batch(size_t capacity = (std::numeric_limits<size_t>::max)()) const
+		{
+			auto& next = m_graph->AddBuffer<T>(capacity);
+			To(next);
+			return { *m_graph, next, {} };
+		}
+
+		// terminates the Flow: "action(value)" is called for every value (fused)
+		template<typename Action>
+		void ForEach(Action action) const
+		{
+			Finalize([action = std::move(action)](auto&& value) mutable {
+				action(std::forward<decltype(value)>(value));
+			});
+		}
+
+		// terminates the Flow: values are sent to "target" (Concurrency::send)
+		void To(Concurrency::ITarget<T>& target) const
+		{
+			Finalize([&target](auto&& value) {
+				send(target, value);
+			});
+		}
+
+		// terminates the Flow: values are sent to "target" (Agents::Send, blocking while "target" is full)
+		void To(BoundedBuffer<T>& target) const
+		{
+			Finalize([&target](auto&& value) {
+				Send(target, value);
+			});
+		}
+
+		// every value is sent to all the branches, each one a new stage reading from a buffer of "capacity".
+		// "branch" is called with the Flow of its stage: either it terminates it (and FanOut returns nothing)
+		// or it returns it and all the results are merged into a new stage (whose Flow is returned)
+		//
+		// flow.FanOut(64,
+		//    [](auto branch) { return branch.Transform(ToCelsius); },
+		//    [](auto branch) { return branch.Transform(ToFahrenheit); })
+		//  .ForEach(Print);
+		template<typename... Branches>
+		auto FanOut(size_t capacity, Branches... branches) const
+		{
+			static_assert(sizeof...(Branches) > 0, "FanOut needs at least one branch");
+			using BranchFlow = Flow<T, T, Details::ParallelStage<1>>;
+			using Results = std::tuple<std::invoke_result_t<Branches&, BranchFlow>...>;
+			constexpr auto merge = !std::is_void_v<std::tuple_element_t<0, Results>>;
+
+			std::vector<BoundedBuffer<T>*> targets{ (static_cast<void>(branches), &m_graph->AddBuffer<T>(capacity))... };
+			Finalize([targets](auto&& value) {
+				for (auto* target : targets)
+				{
+					Send(*target, value);
+				}
+			});
+
+			size_t i = 0;
+			if constexpr (merge)
+			{
+				using Merged = typename std::tuple_element_t<0, Results>::value_type;
+				static_assert((std::is_same_v<typename std::invoke_result_t<Branches&, BranchFlow>::value_type, Merged> && ...), "merged branches must produce the same type");
+				auto& merged = m_graph->AddBuffer<Merged>(capacity);
+				(branches(BranchFlow{ *m_graph, *targets[i++], {} }).To(merged), ...);
+				return Flow<Merged, Merged, Details::ParallelStage<1>>{ *m_graph, merged, {} };
+			}
+			else
+			{
+				static_assert((std::is_void_v<std::invoke_result_t<Branches&, BranchFlow>> && ...), "either all or none of the branches must return their Flow");
+				(branches(BranchFlow{ *m_graph, *targets[i++], {} }), ...);
+			}
+		}
+	private:
+		template<typename, typename, typename, typename...>
+		friend class Flow;
+
+		template<typename>
+		friend class Pipeline;
+
+		Flow(Details::PipelineGraph& graph, BoundedBuffer<StageInput>& source, std::tuple<Ops...> ops)
+			: m_graph(&graph), m_source(&source), m_ops(std::move(ops))
+		{
+
+		}
+
+		// creates the stage: its consumer applies the fused functions and then "emit"
+		template<typename Emit>
+		void Finalize(Emit emit) const
+		{
+			auto chain = Bind<0>(std::move(emit));
+			m_graph->AddStage<typename StageKind::template Agent<StageInput, decltype(chain)>>(*m_source, std::move(chain));
+		}
+
+		template<size_t I, typename Emit>
+		auto Bind(Emit emit) const
+		{
+			if constexpr (I == sizeof...(Ops))
+			{
+				return emit;
+			}
+			else
+			{
+				return std::get<I>(m_ops).Bind(Bind<I + 1>(std::move(emit)));
+			}
+		}
+
+		Details::PipelineGraph* m_graph;
+		BoundedBuffer<StageInput>* m_source;
+		std::tuple<Ops...> m_ops;
+	};
+
+	template<typename In>
+	class Pipeline
+	{
+	public:
+		explicit Pipeline(size_t capacity = (std::numeric_limits<size_t>::max)())
+			: m_input(capacity)
+		{
+
+		}
+
+		Pipeline(const Pipeline&) = delete;
+		Pipeline& operator=(const Pipeline&) = delete;
+
+		~Pipeline()
+		{
+			if (m_started)
+			{
+				StopAndWait();
+			}
+		}
+
+		// where messages enter the pipeline
+		BoundedBuffer<In>& Input()
+		{
+			return m_input;
+		}
+
+		// the Flow of the first stage ("DegreeOfParallelism" consumers reading from Input), to be called once
+		template<size_t DegreeOfParallelism = 1>
+		[[nodiscard]] Flow<In, In, Details::ParallelStage<DegreeOfParallelism>> From()
+		{
+			return { m_graph, m_input, {} };
+		}
+
+		// starts all the stages, from the tail
+		void Start()
+		{
+			m_graph.Start();
+			m_started = true;
+		}
+
+		// stops the stages from the head, each one after the previous has processed its last values
+		void StopAndWait()
+		{
+			m_graph.StopAndWait();
+			m_started = false;
+		}
+	private:
+		BoundedBuffer<In> m_input; // declared first: stages are destroyed before
+		Details::PipelineGraph m_graph;
+		bool m_started = false;
+	};
+}
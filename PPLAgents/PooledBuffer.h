@@ -0,0 +1,339 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "Agent.h"
+
+namespace Agents
+{
+	namespace Details
+	{
+		// Fixed-size blocks recycled through per-thread freelists, so that allocating and freeing don't go to the global allocator.
+		// Messages are allocated by producers and freed by consumers: a thread freeing more than it allocates moves batches of blocks
+		// to a shared depot (one lock per batch), where threads running out of blocks take them from.
+		// Blocks are never given back to the heap: the pool is as large as the peak of blocks in flight
+		template<size_t Size, size_t Alignment>
+		class BlockPool
+		{
+		public:
+			static void* Allocate()
+			{
+				auto& cache = LocalCache();
+				if (!cache.head && !Refill(cache))
+				{
+					TheDepot().allocated.fetch_add(1, std::memory_order_relaxed);
+					return ::operator new(BlockSize, std::align_val_t{ Alignment });
+				}
+				auto* block = cache.head;
+				cache.head = block->next;
+				--cache.size;
+				return block;
+			}
+
+			static void Deallocate(void* pointer) noexcept
+			{
+				auto& cache = LocalCache();
+				auto* block = static_cast<Block*>(pointer);
+				block->next = cache.head;
+				cache.head = block;
+				if (++cache.size >= 2 * BatchSize)
+				{
+					Flush(cache, BatchSize);
+				}
+			}
+
+			// blocks allocated from the heap so far (by all threads)
+			static size_t Allocated()
+			{
+				return TheDepot().allocated.load(std::memory_order_relaxed);
+			}
+		private:
+			static constexpr size_t BatchSize = 64;
+
+			struct Block
+			{
+				Block* next;
+			};
+
+			static constexpr size_t BlockSize = Size < sizeof(Block) ? sizeof(Block) : Size;
+
+			struct Depot
+			{
+				std::mutex mutex;
+				std::vector<std::pair<Block*, size_t>> batches; // lists of blocks and their length
+				std::atomic<size_t> allocated = 0;
+			};
+
+			struct Cache
+			{
+				Block* head = nullptr;
+				size_t size = 0;
+
+				~Cache()
+				{
+					// the thread is exiting: its blocks are left to the others
+					Flush(*this, size);
+				}
+			};
+
+			// never destroyed: caches of exiting threads (and blocks freed during static destruction) still go there
+			static Depot& TheDepot()
+			{
+				static auto* depot = new Depot();
+				return *depot;
+			}
+
+			static Cache& LocalCache()
+			{
+				thread_local Cache cache;
+				return cache;
+			}
+
+			static bool Refill(Cache& cache)
+			{
+				auto& depot = TheDepot();
+				std::lock_guard<std::mutex> lock(depot.mutex);
+				if (depot.batches.empty())
+				{
+					return false;
+				}
+				std::tie(cache.head, cache.size) = depot.batches.back();
+				depot.batches.pop_back();
+				return true;
+			}
+
+			// moves the first "count" blocks of "cache" to the depot
+			static void Flush(Cache& cache, size_t count) noexcept
+			{
+				if (count == 0)
+				{
+					return;
+				}
+				auto* first = cache.head;
+				auto* last = first;
+				for (size_t i = 1; i < count; ++i)
+				{
+					last = last->next;
+				}
+				cache.head = last->next;
+				cache.size -= count;
+				last->next = nullptr;
+
+				auto& depot = TheDepot();
+				std::lock_guard<std::mutex> lock(depot.mutex);
+				depot.batches.emplace_back(first, count);
+			}
+		};
+
+		// a message whose node comes from (and goes back to) a BlockPool. It can be deleted as any other message
+		// (message has a virtual destructor), so receivers and blocks don't need to know
+		template<typename T>
+		class PooledMessage : public Concurrency::message<T>
+		{
+		public:
+			using Concurrency::message<T>::message;
+
+			static void* operator new(size_t)
+			{
+				return Pool::Allocate();
+			}
+
+			static void operator delete(void* pointer) noexcept
+			{
+				Pool::Deallocate(pointer);
+			}
+
+			using Pool = BlockPool<sizeof(Concurrency::message<T>), alignof(Concurrency::message<T>)>;
+		};
+
+		static_assert(sizeof(PooledMessage<int>) == sizeof(Concurrency::message<int>), "PooledMessage must not add state to message");
+
+#if !defined(PPLAGENTS_PORTABLE_BACKEND)
+		// ConcRT targets accept a sent message from its source: this one just hands it over (as the internal one of Concurrency::send)
+		template<typename T>
+		class MessageOriginator : public Concurrency::ISource<T>
+		{
+		public:
+			explicit MessageOriginator(Concurrency::message<T>* message)
+				: m_message(message)
+			{
+
+			}
+
+			void link_target(Concurrency::ITarget<T>*) override
+			{
+
+			}
+
+			void unlink_target(Concurrency::ITarget<T>*) override
+			{
+
+			}
+
+			void unlink_targets() override
+			{
+
+			}
+
+			Concurrency::message<T>* accept(Concurrency::runtime_object_identity id, Concurrency::ITarget<T>*) override
+			{
+				return m_message && m_message->msg_id() == id ? std::exchange(m_message, nullptr) : nullptr;
+			}
+
+			bool reserve(Concurrency::runtime_object_identity, Concurrency::ITarget<T>*) override
+			{
+				return false;
+			}
+
+			Concurrency::message<T>* consume(Concurrency::runtime_object_identity id, Concurrency::ITarget<T>* target) override
+			{
+				return accept(id, target);
+			}
+
+			void release(Concurrency::runtime_object_identity, Concurrency::ITarget<T>*) override
+			{
+
+			}
+
+			void acquire_ref(Concurrency::ITarget<T>*) override
+			{
+
+			}
+
+			void release_ref(Concurrency::ITarget<T>*) override
+			{
+
+			}
+		private:
+			Concurrency::message<T>* m_message;
+		};
+#endif
+
+		// sends "value" to "target" in a message from the pool
+		template<typename T>
+		bool SendPooled(Concurrency::ITarget<T>& target, const T& value)
+		{
+			std::unique_ptr<Concurrency::message<T>> message{ new PooledMessage<T>(value) };
+#if defined(PPLAGENTS_PORTABLE_BACKEND)
+			if (target.send(message.get(), nullptr) != Concurrency::accepted)
+			{
+				return false;
+			}
+#else
+			MessageOriginator<T> originator{ message.get() };
+			if (target.send(message.get(), &originator) != Concurrency::accepted)
+			{
+				return false;
+			}
+#endif
+			message.release(); // owned by "target" now
+			return true;
+		}
+	}
+
+	// An unbounded_buffer whose messages, sent with Agents::Send, recycle their nodes instead of allocating one each:
+	// nodes come from a per-thread freelist of the producer and go back to the one of whoever frees them (the consumer),
+	// batches of them move from consumers to producers through a shared depot (see Details::BlockPool).
+	// It can be used wherever an unbounded_buffer is (also as a Consumer m_buffer), messages sent by other means are just not pooled.
+	// Nodes are shared by all the PooledBuffers of payloads of the same size.
+	//
+	// PooledBuffer<int> buffer;
+	// Send(buffer, 42);
+	//
+	// To recycle payloads that allocate themselves (e.g. strings, vectors), see PayloadPool
+	template<typename T>
+	class PooledBuffer : public Concurrency::unbounded_buffer<T>
+	{
+	public:
+		// nodes allocated from the heap so far (by all the PooledBuffers of payloads of the same size)
+		[[nodiscard]] static size_t AllocatedNodes()
+		{
+			return Details::PooledMessage<T>::Pool::Allocated();
+		}
+	};
+
+	// sends "value" to "target" in a pooled message
+	template<typename T>
+	bool Send(PooledBuffer<T>& target, const T& value)
+	{
+		return Details::SendPooled<T>(target, value);
+	}
+
+	// Recycles payload objects, so that the memory they own (e.g. the capacity of a string or a vector) is reused.
+	// Acquire() returns a handle: when destroyed (e.g. after Consume), the object goes back to the pool as it is (not cleared).
+	// Handles are move-only: to send them, wrap them in Utils::Movable:
+	//
+	// PayloadPool<std::string> texts;
+	// PooledBuffer<Utils::Movable<PayloadPool<std::string>::Handle>> buffer;
+	// auto text = texts.Acquire();
+	// text->assign("hello");
+	// Send(buffer, Utils::Movable{ std::move(text) });
+	// ... void Consume(PayloadPool<std::string>::Handle text) { ... } // back to the pool on return
+	//
+	// The pool is thread-safe and must outlive its handles
+	template<typename T>
+	class PayloadPool
+	{
+	public:
+		class Returner
+		{
+		public:
+			Returner() = default;
+
+			explicit Returner(PayloadPool* pool)
+				: m_pool(pool)
+			{
+
+			}
+
+			void operator()(T* object) const
+			{
+				m_pool->Release(object);
+			}
+		private:
+			PayloadPool* m_pool = nullptr;
+		};
+
+		using Handle = std::unique_ptr<T, Returner>;
+
+		PayloadPool() = default;
+		PayloadPool(const PayloadPool&) = delete;
+		PayloadPool& operator=(const PayloadPool&) = delete;
+
+		// a recycled object (as it was left by its last user) or a value-initialized one if none is available
+		Handle Acquire()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_free.empty())
+				{
+					auto* object = m_free.back().release();
+					m_free.pop_back();
+					return Handle{ object, Returner{ this } };
+				}
+			}
+			m_created.fetch_add(1, std::memory_order_relaxed);
+			return Handle{ new T(), Returner{ this } };
+		}
+
+		// objects created so far (the others have been recycled)
+		[[nodiscard]] size_t Created() const
+		{
+			return m_created.load(std::memory_order_relaxed);
+		}
+	private:
+		void Release(T* object)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_free.emplace_back(object);
+		}
+
+		std::mutex m_mutex;
+		std::vector<std::unique_ptr<T>> m_free;
+		std::atomic<size_t> m_created = 0;
+	};
+}
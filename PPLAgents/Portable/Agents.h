@@ -0,0 +1,5 @@
+#pragma once
+// Portable replacement of <agents.h>: the subset of the Asynchronous Agents Library used by PPLAgents, on top of the standard library.
+// Include Backend.h instead of this one
+#include "MessageBlocks.h"
+#include "BaseAgent.h"
\ No newline at end of file
@@ -0,0 +1,181 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include "MessageBlocks.h"
+#include "Scheduler.h"
+
+namespace Agents::Portable
+{
+	enum agent_status
+	{
+		agent_created,
+		agent_runnable,
+		agent_started,
+		agent_done,
+		agent_canceled
+	};
+
+	// Portable implementation of Concurrency::agent: run() is executed on a thread of the scheduler given on construction
+	// or, if none, of the current one when start() is called (see Scheduler::Current).
+	// As with ConcRT, done() must be called (by run() or later, by whoever finishes the work), otherwise waiting for the agent never completes
+	class agent
+	{
+	public:
+		agent() = default;
+
+		explicit agent(Scheduler& scheduler)
+			: m_scheduler(&scheduler)
+		{
+
+		}
+
+		agent(const agent&) = delete;
+		agent& operator=(const agent&) = delete;
+		virtual ~agent() = default;
+
+		bool start()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_status != agent_created)
+				{
+					return false;
+				}
+				m_status = agent_runnable;
+			}
+			(m_scheduler ? *m_scheduler : Scheduler::Current()).Schedule([this] {
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_status = agent_started;
+				}
+				run();
+				// "this" might be already destroyed here (after done())
+			});
+			return true;
+		}
+
+		agent_status status()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_status;
+		}
+
+		// blocks until "agent" is done (or throws operation_timed_out when "timeout" expires)
+		static agent_status wait(agent* agent, unsigned int timeout = COOPERATIVE_TIMEOUT_INFINITE)
+		{
+			std::unique_lock<std::mutex> lock(agent->m_mutex);
+			const auto isDone = [agent] { return agent->IsDone(); };
+			if (const auto deadline = Details::DeadlineOf(timeout))
+			{
+				if (!agent->m_finished.wait_until(lock, *deadline, isDone))
+				{
+					throw operation_timed_out();
+				}
+			}
+			else
+			{
+				agent->m_finished.wait(lock, isDone);
+			}
+			return agent->m_status;
+		}
+
+		// blocks until one of the "count" "agents" is done, its status and index are stored in "status" and "index"
+		// (or throws operation_timed_out when "timeout" expires). Agents must outlive the call
+		static void wait_for_one(size_t count, agent** agents, agent_status& status, size_t& index, unsigned int timeout = COOPERATIVE_TIMEOUT_INFINITE)
+		{
+			Details::Waiter waiter;
+			struct Unregister
+			{
+				~Unregister()
+				{
+					for (size_t i = 0; i < registered; ++i)
+					{
+						std::lock_guard<std::mutex> lock(agents[i]->m_mutex);
+						agents[i]->m_waiters.Remove(&waiter);
+					}
+				}
+
+				agent** agents;
+				Details::Waiter& waiter;
+				size_t registered;
+			} unregister{ agents, waiter, 0 };
+			auto& registered = unregister.registered;
+
+			const auto deadline = Details::DeadlineOf(timeout);
+			while (true)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					std::lock_guard<std::mutex> lock(agents[i]->m_mutex);
+					if (agents[i]->IsDone())
+					{
+						status = agents[i]->m_status;
+						index = i;
+						return;
+					}
+					// registered once, the first time: a later done() signals the waiter
+					if (i == registered)
+					{
+						agents[i]->m_waiters.Add(&waiter);
+						++registered;
+					}
+				}
+				if (!waiter.WaitUntil(deadline))
+				{
+					throw operation_timed_out();
+				}
+			}
+		}
+
+		// blocks until all the "count" "agents" are done, their statuses are stored in "statuses" (if not null)
+		// (or throws operation_timed_out when "timeout" expires)
+		static void wait_for_all(size_t count, agent** agents, agent_status* statuses, unsigned int timeout = COOPERATIVE_TIMEOUT_INFINITE)
+		{
+			const auto deadline = Details::DeadlineOf(timeout);
+			for (size_t i = 0; i < count; ++i)
+			{
+				auto remaining = COOPERATIVE_TIMEOUT_INFINITE;
+				if (deadline)
+				{
+					const auto left = std::chrono::ceil<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now()).count();
+					remaining = left > 0 ? static_cast<unsigned int>(left) : 0;
+				}
+				const auto status = wait(agents[i], remaining);
+				if (statuses)
+				{
+					statuses[i] = status;
+				}
+			}
+		}
+	protected:
+		virtual void run() = 0;
+
+		// the agent can be destroyed (by who is waiting) as soon as this function returns
+		bool done()
+		{
+			// notifying under the lock: a waiter can't wake up (and destroy the agent) before notify_all has returned
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (IsDone())
+			{
+				return false;
+			}
+			m_status = agent_done;
+			m_finished.notify_all();
+			m_waiters.SignalAll();
+			return true;
+		}
+	private:
+		// under m_mutex
+		bool IsDone() const
+		{
+			return m_status == agent_done || m_status == agent_canceled;
+		}
+
+		Scheduler* m_scheduler = nullptr;
+		std::mutex m_mutex;
+		std::condition_variable m_finished;
+		agent_status m_status = agent_created;
+		Details::Waiters m_waiters; // of wait_for_one
+	};
+}
\ No newline at end of file
@@ -0,0 +1,966 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Portable implementation of the subset of ConcRT message blocks used by this library (same names and semantics).
+// Differences from ConcRT:
+// - messages are offered to linked targets synchronously (in the context of the sender)
+// - reservation (reserve/consume/release) is not supported: receivers take messages via try_take
+// - try_take, register_waiter and unregister_waiter are portable-only extensions of ISource every block implements
+// - message payloads are not const: try_take moves them out of the buffer and send moves an rvalue in (no copies)
+namespace Agents::Portable
+{
+	const unsigned int COOPERATIVE_TIMEOUT_INFINITE = static_cast<unsigned int>(-1);
+
+	using runtime_object_identity = std::intptr_t;
+
+	class operation_timed_out : public std::exception
+	{
+	public:
+		[[nodiscard]] const char* what() const noexcept override
+		{
+			return "operation timed out";
+		}
+	};
+
+	enum message_status
+	{
+		accepted,
+		declined,
+		postponed,
+		missed
+	};
+
+	template<typename T>
+	class message
+	{
+	public:
+		explicit message(const T& p)
+			: payload(p)
+		{
+
+		}
+
+		explicit message(T&& p)
+			: payload(std::move(p))
+		{
+
+		}
+
+		message(const message&) = delete;
+		message& operator=(const message&) = delete;
+		// like in ConcRT: messages can be subclassed (e.g. to be allocated from a pool) and deleted by any block
+		virtual ~message() = default;
+
+		// unique while the message is alive, no need to generate (and contend on) a counter
+		[[nodiscard]] runtime_object_identity msg_id() const noexcept
+		{
+			return reinterpret_cast<runtime_object_identity>(this);
+		}
+
+		// not const (unlike ConcRT): the block taking the message out of a buffer (try_take) owns it and moves the payload out
+		T payload;
+	private:
+		template<typename>
+		friend class unbounded_buffer;
+
+		message* m_next = nullptr;
+	};
+
+	namespace Details
+	{
+		// one blocked receiver, signaled by sources when something might be available.
+		// Signal is called under the lock of the source: once unregistered, a waiter is not signaled anymore.
+		// Signal can be overridden to be notified instead of blocking in WaitUntil (e.g. to resume a coroutine)
+		class Waiter
+		{
+		public:
+			virtual ~Waiter() = default;
+
+			virtual void Signal()
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_signaled = true;
+				}
+				m_cv.notify_one();
+			}
+
+			// false if "deadline" has passed before being signaled
+			bool WaitUntil(const std::optional<std::chrono::steady_clock::time_point>& deadline)
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (deadline)
+				{
+					if (!m_cv.wait_until(lock, *deadline, [this] { return m_signaled; }))
+					{
+						return false;
+					}
+				}
+				else
+				{
+					m_cv.wait(lock, [this] { return m_signaled; });
+				}
+				m_signaled = false;
+				return true;
+			}
+		private:
+			std::mutex m_mutex;
+			std::condition_variable m_cv;
+			bool m_signaled = false;
+		};
+
+		inline std::optional<std::chrono::steady_clock::time_point> DeadlineOf(unsigned int timeout)
+		{
+			if (timeout == COOPERATIVE_TIMEOUT_INFINITE)
+			{
+				return std::nullopt;
+			}
+			return std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		}
+
+		// waiters registered on a block (guarded by the block mutex)
+		class Waiters
+		{
+		public:
+			void Add(Waiter* waiter)
+			{
+				m_waiters.push_back(waiter);
+			}
+
+			void Remove(Waiter* waiter)
+			{
+				for (auto& w : m_waiters)
+				{
+					if (w == waiter)
+					{
+						w = m_waiters.back();
+						m_waiters.pop_back();
+						return;
+					}
+				}
+			}
+
+			void SignalAll() const
+			{
+				for (auto* waiter : m_waiters)
+				{
+					waiter->Signal();
+				}
+			}
+		private:
+			std::vector<Waiter*> m_waiters;
+		};
+	}
+
+	template<typename T>
+	class ITarget;
+
+	template<typename T>
+	class ISource
+	{
+	public:
+		using source_type = T;
+
+		virtual ~ISource() = default;
+
+		virtual void link_target(ITarget<T>* target) = 0;
+		virtual void unlink_target(ITarget<T>* target) = 0;
+		virtual void unlink_targets() = 0;
+		// gives the ownership of the message "id" (offered to "target") to the caller, nullptr if it's not available anymore
+		virtual message<T>* accept(runtime_object_identity id, ITarget<T>* target) = 0;
+
+		// portable-only: takes (or copies, depending on the block) the next value, without blocking
+		virtual bool try_take(T& out) = 0;
+		// portable-only: "waiter" is signaled whenever try_take might succeed
+		virtual void register_waiter(Details::Waiter* waiter) = 0;
+		virtual void unregister_waiter(Details::Waiter* waiter) = 0;
+	};
+
+	template<typename T>
+	class ITarget
+	{
+	public:
+		using type = T;
+
+		virtual ~ITarget() = default;
+
+		// "source" offers "msg": the target calls source->accept to take it (if "source" is nullptr, "msg" is given directly).
+		// Unless accepted, the ownership of "msg" stays to the caller
+		virtual message_status propagate(message<T>* msg, ISource<T>* source) = 0;
+		virtual message_status send(message<T>* msg, ISource<T>* source) = 0;
+
+		virtual bool supports_anonymous_source()
+		{
+			return false;
+		}
+	protected:
+		template<typename>
+		friend class unbounded_buffer;
+		template<typename>
+		friend class overwrite_buffer;
+		template<typename>
+		friend class single_assignment;
+
+		virtual void link_source(ISource<T>* source) = 0;
+		virtual void unlink_source(ISource<T>* source) = 0;
+		virtual void unlink_sources() = 0;
+	};
+
+	namespace Details
+	{
+		// takes the ownership of "msg", offered by "source"
+		template<typename T>
+		message<T>* Acquire(message<T>* msg, ISource<T>* source, ITarget<T>* target)
+		{
+			return source ? source->accept(msg->msg_id(), target) : msg;
+		}
+
+		// the linked targets of a block (guarded by the block mutex)
+		template<typename T>
+		class Targets
+		{
+		public:
+			void Add(ITarget<T>* target)
+			{
+				m_targets.push_back(target);
+			}
+
+			void Remove(ITarget<T>* target)
+			{
+				for (auto it = m_targets.begin(); it != m_targets.end(); ++it)
+				{
+					if (*it == target)
+					{
+						m_targets.erase(it);
+						return;
+					}
+				}
+			}
+
+			[[nodiscard]] std::vector<ITarget<T>*> Release()
+			{
+				return std::exchange(m_targets, {});
+			}
+
+			[[nodiscard]] bool Empty() const
+			{
+				return m_targets.empty();
+			}
+
+			[[nodiscard]] std::vector<ITarget<T>*> Copy() const
+			{
+				return m_targets;
+			}
+		private:
+			std::vector<ITarget<T>*> m_targets;
+		};
+	}
+
+	// FIFO of messages, each one is delivered to exactly one receiver (or linked target)
+	template<typename T>
+	class unbounded_buffer : public ISource<T>, public ITarget<T>
+	{
+	public:
+		unbounded_buffer() = default;
+		unbounded_buffer(const unbounded_buffer&) = delete;
+		unbounded_buffer& operator=(const unbounded_buffer&) = delete;
+
+		~unbounded_buffer() override
+		{
+			unlink_targets();
+			while (m_head)
+			{
+				delete std::exchange(m_head, m_head->m_next);
+			}
+		}
+
+		void link_target(ITarget<T>* target) override
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_targets.Add(target);
+			}
+			target->link_source(this);
+			OfferToTargets();
+		}
+
+		void unlink_target(ITarget<T>* target) override
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_targets.Remove(target);
+			}
+			target->unlink_source(this);
+		}
+
+		void unlink_targets() override
+		{
+			std::vector<ITarget<T>*> targets;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				targets = m_targets.Release();
+			}
+			for (auto* target : targets)
+			{
+				target->unlink_source(this);
+			}
+		}
+
+		message<T>* accept(runtime_object_identity id, ITarget<T>*) override
+		{
+			return accept_message(id);
+		}
+
+		message_status propagate(message<T>* msg, ISource<T>* source) override
+		{
+			return propagate_message(msg, source);
+		}
+
+		message_status send(message<T>* msg, ISource<T>* source) override
+		{
+			return send_message(msg, source);
+		}
+
+		bool supports_anonymous_source() override
+		{
+			return true;
+		}
+
+		bool try_take(T& out) override
+		{
+			// through take_message, so that subclasses see every message leaving the buffer
+			auto* msg = take_message();
+			if (!msg)
+			{
+				return false;
+			}
+			out = std::move(msg->payload);
+			delete msg;
+			return true;
+		}
+
+		void register_waiter(Details::Waiter* waiter) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_waiters.Add(waiter);
+		}
+
+		void unregister_waiter(Details::Waiter* waiter) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_waiters.Remove(waiter);
+		}
+	protected:
+		// removes and returns the message "id" if it's the next one
+		virtual message<T>* accept_message(runtime_object_identity id)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_head || m_head->msg_id() != id)
+			{
+				return nullptr;
+			}
+			return PopHead();
+		}
+
+		// portable-only: removes and returns the next message (nullptr if there is none) in a single critical section.
+		// Receivers (try_take) take messages this way, linked targets through accept_message: a subclass seeing the messages
+		// leaving the buffer (e.g. BoundedBuffer) overrides both
+		virtual message<T>* take_message()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_head ? PopHead() : nullptr;
+		}
+
+		// reservation is not supported, so consuming is just accepting
+		virtual message<T>* consume_message(runtime_object_identity id)
+		{
+			return accept_message(id);
+		}
+
+		virtual message_status propagate_message(message<T>* msg, ISource<T>* source)
+		{
+			return Enqueue(Details::Acquire(msg, source, this));
+		}
+
+		virtual message_status send_message(message<T>* msg, ISource<T>* source)
+		{
+			return Enqueue(Details::Acquire(msg, source, this));
+		}
+
+		void link_source(ISource<T>*) override
+		{
+
+		}
+
+		void unlink_source(ISource<T>*) override
+		{
+
+		}
+
+		void unlink_sources() override
+		{
+
+		}
+	private:
+		// m_mutex held, m_head not null
+		message<T>* PopHead()
+		{
+			auto* msg = std::exchange(m_head, m_head->m_next);
+			if (!m_head)
+			{
+				m_tail = nullptr;
+			}
+			msg->m_next = nullptr;
+			return msg;
+		}
+
+		message_status Enqueue(message<T>* msg)
+		{
+			if (!msg)
+			{
+				return missed;
+			}
+			bool hasTargets;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_tail)
+				{
+					m_tail->m_next = msg;
+				}
+				else
+				{
+					m_head = msg;
+				}
+				m_tail = msg;
+				m_waiters.SignalAll();
+				hasTargets = !m_targets.Empty();
+			}
+			if (hasTargets)
+			{
+				OfferToTargets();
+			}
+			return accepted;
+		}
+
+		// offers pending messages (in order) to linked targets until one is not taken
+		void OfferToTargets()
+		{
+			while (true)
+			{
+				message<T>* head;
+				std::vector<ITarget<T>*> targets;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					if (!m_head || m_targets.Empty())
+					{
+						return;
+					}
+					head = m_head;
+					targets = m_targets.Copy();
+				}
+				auto taken = false;
+				for (auto* target : targets)
+				{
+					// "head" can be accessed only here: if another receiver takes it, target->propagate calls accept
+					// that returns nullptr without touching it
+					if (target->propagate(head, this) == accepted)
+					{
+						taken = true;
+						break;
+					}
+				}
+				if (!taken)
+				{
+					return;
+				}
+			}
+		}
+
+		std::mutex m_mutex;
+		message<T>* m_head = nullptr;
+		message<T>* m_tail = nullptr;
+		Details::Waiters m_waiters;
+		Details::Targets<T> m_targets;
+	};
+
+	// holds the latest value: receiving copies it (it's not removed)
+	template<typename T>
+	class overwrite_buffer : public ISource<T>, public ITarget<T>
+	{
+	public:
+		overwrite_buffer() = default;
+		overwrite_buffer(const overwrite_buffer&) = delete;
+		overwrite_buffer& operator=(const overwrite_buffer&) = delete;
+
+		[[nodiscard]] bool has_value()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_value.has_value();
+		}
+
+		void link_target(ITarget<T>*) override
+		{
+			// values stay here: nothing to propagate
+		}
+
+		void unlink_target(ITarget<T>*) override
+		{
+
+		}
+
+		void unlink_targets() override
+		{
+
+		}
+
+		message<T>* accept(runtime_object_identity, ITarget<T>*) override
+		{
+			return nullptr;
+		}
+
+		message_status propagate(message<T>* msg, ISource<T>* source) override
+		{
+			return Store(msg, source);
+		}
+
+		message_status send(message<T>* msg, ISource<T>* source) override
+		{
+			return Store(msg, source);
+		}
+
+		bool supports_anonymous_source() override
+		{
+			return true;
+		}
+
+		bool try_take(T& out) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_value)
+			{
+				return false;
+			}
+			out = *m_value;
+			return true;
+		}
+
+		void register_waiter(Details::Waiter* waiter) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_waiters.Add(waiter);
+		}
+
+		void unregister_waiter(Details::Waiter* waiter) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_waiters.Remove(waiter);
+		}
+	protected:
+		void link_source(ISource<T>*) override
+		{
+
+		}
+
+		void unlink_source(ISource<T>*) override
+		{
+
+		}
+
+		void unlink_sources() override
+		{
+
+		}
+	private:
+		message_status Store(message<T>* msg, ISource<T>* source)
+		{
+			msg = Details::Acquire(msg, source, this);
+			if (!msg)
+			{
+				return missed;
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_value.emplace(msg->payload);
+				m_waiters.SignalAll();
+			}
+			delete msg;
+			return accepted;
+		}
+
+		std::mutex m_mutex;
+		std::optional<T> m_value;
+		Details::Waiters m_waiters;
+	};
+
+	// holds the first value ever received: receiving copies it (it's not removed), next messages are declined
+	template<typename T>
+	class single_assignment : public ISource<T>, public ITarget<T>
+	{
+	public:
+		single_assignment() = default;
+		single_assignment(const single_assignment&) = delete;
+		single_assignment& operator=(const single_assignment&) = delete;
+
+		[[nodiscard]] bool has_value()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_value.has_value();
+		}
+
+		// has_value() must be true
+		const T& value()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return *m_value;
+		}
+
+		void link_target(ITarget<T>*) override
+		{
+
+		}
+
+		void unlink_target(ITarget<T>*) override
+		{
+
+		}
+
+		void unlink_targets() override
+		{
+
+		}
+
+		message<T>* accept(runtime_object_identity, ITarget<T>*) override
+		{
+			return nullptr;
+		}
+
+		message_status propagate(message<T>* msg, ISource<T>* source) override
+		{
+			return Assign(msg, source);
+		}
+
+		message_status send(message<T>* msg, ISource<T>* source) override
+		{
+			return Assign(msg, source);
+		}
+
+		bool supports_anonymous_source() override
+		{
+			return true;
+		}
+
+		bool try_take(T& out) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_value)
+			{
+				return false;
+			}
+			out = *m_value;
+			return true;
+		}
+
+		void register_waiter(Details::Waiter* waiter) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_waiters.Add(waiter);
+		}
+
+		void unregister_waiter(Details::Waiter* waiter) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_waiters.Remove(waiter);
+		}
+	protected:
+		void link_source(ISource<T>*) override
+		{
+
+		}
+
+		void unlink_source(ISource<T>*) override
+		{
+
+		}
+
+		void unlink_sources() override
+		{
+
+		}
+	private:
+		message_status Assign(message<T>* msg, ISource<T>* source)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_value)
+				{
+					return declined;
+				}
+			}
+			msg = Details::Acquire(msg, source, this);
+			if (!msg)
+			{
+				return missed;
+			}
+			auto assigned = false;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_value)
+				{
+					m_value.emplace(msg->payload);
+					m_waiters.SignalAll();
+					assigned = true;
+				}
+			}
+			delete msg;
+			return assigned ? accepted : declined;
+		}
+
+		std::mutex m_mutex;
+		std::optional<T> m_value;
+		Details::Waiters m_waiters;
+	};
+
+	// receives from the first of its sources having a message (in the order they are given) and produces its index.
+	// Like single_assignment, once it has an index it does not change
+	template<typename... Sources>
+	class choice : public ISource<size_t>
+	{
+	public:
+		explicit choice(Sources... sources)
+			: m_sources(sources...)
+		{
+
+		}
+
+		choice(const choice&) = delete;
+		choice& operator=(const choice&) = delete;
+
+		// true if the value of the chosen source has been taken
+		[[nodiscard]] bool has_value() const
+		{
+			return m_index.has_value();
+		}
+
+		[[nodiscard]] size_t index() const
+		{
+			return *m_index;
+		}
+
+		// the value taken from the chosen source, whose payload type must be "Payload"
+		template<typename Payload>
+		const Payload& value() const
+		{
+			const Payload* value = nullptr;
+			Find<Payload>(value, std::index_sequence_for<Sources...>{});
+			return *value;
+		}
+
+		void link_target(ITarget<size_t>*) override
+		{
+
+		}
+
+		void unlink_target(ITarget<size_t>*) override
+		{
+
+		}
+
+		void unlink_targets() override
+		{
+
+		}
+
+		message<size_t>* accept(runtime_object_identity, ITarget<size_t>*) override
+		{
+			return nullptr;
+		}
+
+		bool try_take(size_t& out) override
+		{
+			if (!m_index)
+			{
+				TakeFirst(std::index_sequence_for<Sources...>{});
+			}
+			if (m_index)
+			{
+				out = *m_index;
+			}
+			return m_index.has_value();
+		}
+
+		void register_waiter(Details::Waiter* waiter) override
+		{
+			std::apply([waiter](auto*... source) { (source->register_waiter(waiter), ...); }, m_sources);
+		}
+
+		void unregister_waiter(Details::Waiter* waiter) override
+		{
+			std::apply([waiter](auto*... source) { (source->unregister_waiter(waiter), ...); }, m_sources);
+		}
+	private:
+		template<size_t... Is>
+		void TakeFirst(std::index_sequence<Is...>)
+		{
+			// short-circuit: sources are tried in order
+			(void)((std::get<Is>(m_sources)->try_take(std::get<Is>(m_values).emplace()) ? (m_index = Is, true) : (std::get<Is>(m_values).reset(), false)) || ...);
+		}
+
+		template<typename Payload, size_t... Is>
+		void Find(const Payload*& value, std::index_sequence<Is...>) const
+		{
+			((std::is_same_v<Payload, typename std::remove_pointer_t<Sources>::source_type> && m_index == Is ? (value = Get<Payload, Is>(), true) : false) || ...);
+		}
+
+		template<typename Payload, size_t I>
+		const Payload* Get() const
+		{
+			if constexpr (std::is_same_v<Payload, typename std::remove_pointer_t<std::tuple_element_t<I, std::tuple<Sources...>>>::source_type>)
+			{
+				return &*std::get<I>(m_values);
+			}
+			else
+			{
+				return nullptr;
+			}
+		}
+
+		std::tuple<Sources...> m_sources;
+		std::tuple<std::optional<typename std::remove_pointer_t<Sources>::source_type>...> m_values;
+		std::optional<size_t> m_index;
+	};
+
+	template<typename... Sources>
+	choice<Sources...> make_choice(Sources... sources)
+	{
+		return choice<Sources...>(sources...);
+	}
+
+	template<typename T>
+	bool try_receive(ISource<T>& source, T& out)
+	{
+		return source.try_take(out);
+	}
+
+	template<typename T>
+	bool try_receive(ISource<T>* source, T& out)
+	{
+		return source->try_take(out);
+	}
+
+	// blocks until "source" has a value and takes it to "out", or returns false when "timeout" expires.
+	// Not in ConcRT (portable only): receive is implemented on top of it, throwing is left to the caller
+	template<typename T>
+	bool try_receive_for(ISource<T>& source, T& out, unsigned int timeout)
+	{
+		if (source.try_take(out))
+		{
+			return true;
+		}
+		// 0 is just a poll: even an already expired timed wait costs tens of microseconds (timer slack)
+		if (timeout == 0)
+		{
+			return false;
+		}
+
+		Details::Waiter waiter;
+		source.register_waiter(&waiter);
+		struct Unregister
+		{
+			~Unregister()
+			{
+				source.unregister_waiter(&waiter);
+			}
+
+			ISource<T>& source;
+			Details::Waiter& waiter;
+		} unregister{ source, waiter };
+
+		const auto deadline = Details::DeadlineOf(timeout);
+		// checking again after registering: something might have arrived in the meantime
+		while (!source.try_take(out))
+		{
+			if (!waiter.WaitUntil(deadline))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// blocks until "source" has a value (or throws operation_timed_out when "timeout" expires)
+	template<typename T>
+	T receive(ISource<T>& source, unsigned int timeout = COOPERATIVE_TIMEOUT_INFINITE)
+	{
+		T out{};
+		if (!try_receive_for(source, out, timeout))
+		{
+			throw operation_timed_out();
+		}
+		return out;
+	}
+
+	template<typename T>
+	T receive(ISource<T>* source, unsigned int timeout = COOPERATIVE_TIMEOUT_INFINITE)
+	{
+		return receive(*source, timeout);
+	}
+
+	template<typename T>
+	bool send(ITarget<T>& target, const T& value)
+	{
+		auto* msg = new message<T>(value);
+		if (target.send(msg, nullptr) != accepted)
+		{
+			delete msg;
+			return false;
+		}
+		return true;
+	}
+
+	// not in ConcRT (there, sending an rvalue binds to const T& and copies it): moves "value" into the message
+	template<typename T>
+	bool send(ITarget<T>& target, T&& value)
+	{
+		auto* msg = new message<T>(std::move(value));
+		if (target.send(msg, nullptr) != accepted)
+		{
+			delete msg;
+			return false;
+		}
+		return true;
+	}
+
+	template<typename T>
+	bool send(ITarget<T>* target, const T& value)
+	{
+		return send(*target, value);
+	}
+
+	// the portable backend delivers synchronously, so asend is just like send
+	template<typename T>
+	bool asend(ITarget<T>& target, const T& value)
+	{
+		auto* msg = new message<T>(value);
+		if (target.propagate(msg, nullptr) != accepted)
+		{
+			delete msg;
+			return false;
+		}
+		return true;
+	}
+
+	template<typename T>
+	bool asend(ITarget<T>* target, const T& value)
+	{
+		return asend(*target, value);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,295 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Agents::Portable
+{
+	// Elastic pool of reusable threads running agents (what ConcRT calls a scheduler).
+	// Agents block (receiving) for most of their life, so a fixed number of threads would eventually starve or deadlock:
+	// instead, a task never waits for a thread (a new one is started if none is idle) and idle threads are reused,
+	// so starting an agent costs a hand-off and not a thread creation. Threads idle for too long exit.
+	//
+	// - each thread has a local queue: tasks scheduled from a thread of the scheduler (e.g. an agent starting another one)
+	//   go there and are run by the same thread (LIFO, the data is still in cache) unless an idle thread steals them (FIFO)
+	// - threads only run on "cores" (Linux only, elsewhere it's ignored), if not empty
+	// - tasks scheduled from a thread of the scheduler go to that scheduler: agents started by an agent stay on its scheduler
+	//
+	// Destroying a scheduler waits for its threads to exit: tasks (agents) must be completed before
+	class Scheduler
+	{
+	public:
+		explicit Scheduler(std::vector<unsigned> cores = {})
+			: m_cores(std::move(cores))
+		{
+
+		}
+
+		Scheduler(const Scheduler&) = delete;
+		Scheduler& operator=(const Scheduler&) = delete;
+
+		~Scheduler()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_stopping = true;
+			m_taskAvailable.notify_all();
+			m_threadExited.wait(lock, [this] { return m_threads == 0; });
+		}
+
+		// used when no other scheduler is current, never destroyed: agents (and their threads) might outlive static destruction
+		static Scheduler& Default()
+		{
+			static auto* scheduler = new Scheduler();
+			return *scheduler;
+		}
+
+		// the one tasks are scheduled to from this thread: the attached one (see Attach), the one of this thread or Default
+		static Scheduler& Current()
+		{
+			if (CurrentThread().attached)
+			{
+				return *CurrentThread().attached;
+			}
+			if (CurrentThread().worker)
+			{
+				return *CurrentThread().worker->owner;
+			}
+			return Default();
+		}
+
+		// makes this the current scheduler of the calling thread, until Detach. Returns the previously attached one
+		Scheduler* Attach()
+		{
+			return std::exchange(CurrentThread().attached, this);
+		}
+
+		// restores "previous" (returned by Attach) as the attached scheduler of the calling thread
+		static void Detach(Scheduler* previous)
+		{
+			CurrentThread().attached = previous;
+		}
+
+		// the cores the process is allowed to run on, in order (Linux only, elsewhere it's empty)
+		static std::vector<unsigned> AllowedCores()
+		{
+			std::vector<unsigned> cores;
+#if defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			if (sched_getaffinity(0, sizeof(set), &set) == 0)
+			{
+				for (unsigned core = 0; core < CPU_SETSIZE; ++core)
+				{
+					if (CPU_ISSET(core, &set))
+					{
+						cores.push_back(core);
+					}
+				}
+			}
+#endif
+			return cores;
+		}
+
+		// the tasks of the library (starting an agent, resuming a coroutine) capture a single pointer, that std::function stores
+		// inline: scheduling them doesn't allocate (but for the growth of the queues)
+		void Schedule(std::function<void()> task)
+		{
+			auto* worker = CurrentThread().worker;
+			if (worker && worker->owner == this)
+			{
+				std::lock_guard<std::mutex> lock(worker->mutex);
+				worker->tasks.push_back(std::move(task));
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(m_globalMutex);
+				m_global.push_back(std::move(task));
+			}
+
+			auto startThread = false;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				++m_queued;
+				startThread = m_queued > m_idle;
+				if (startThread)
+				{
+					++m_threads;
+				}
+			}
+			if (startThread)
+			{
+				std::thread([this] { Work(); }).detach();
+			}
+			else
+			{
+				m_taskAvailable.notify_one();
+			}
+		}
+	private:
+		struct Worker
+		{
+			Scheduler* owner;
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		struct ThreadState
+		{
+			Worker* worker = nullptr;
+			Scheduler* attached = nullptr;
+		};
+
+		static ThreadState& CurrentThread()
+		{
+			thread_local ThreadState state;
+			return state;
+		}
+
+		void Work()
+		{
+			PinToCores();
+			Worker worker{ this, {}, {} };
+			CurrentThread().worker = &worker;
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_workers.push_back(&worker);
+			while (true)
+			{
+				++m_idle;
+				const auto hasTask = m_taskAvailable.wait_for(lock, MaxIdleTime, [this] { return m_queued > 0 || m_stopping; });
+				--m_idle;
+				if (!hasTask || m_queued == 0)
+				{
+					break;
+				}
+				--m_queued; // reserved: a task is in some queue for this thread
+				lock.unlock();
+				auto task = Take(worker);
+				task();
+				lock.lock();
+			}
+
+			// tasks reserved by other threads might still be here
+			{
+				std::lock_guard<std::mutex> globalLock(m_globalMutex);
+				std::lock_guard<std::mutex> workerLock(worker.mutex);
+				for (auto& task : worker.tasks)
+				{
+					m_global.push_back(std::move(task));
+				}
+			}
+			for (auto& w : m_workers)
+			{
+				if (w == &worker)
+				{
+					w = m_workers.back();
+					m_workers.pop_back();
+					break;
+				}
+			}
+			CurrentThread().worker = nullptr;
+			--m_threads;
+			// notifying under the lock: the destructor can't complete before notify_all has returned
+			m_threadExited.notify_all();
+		}
+
+		// own queue (newest first), then the global queue, then steals from other threads (oldest first)
+		std::function<void()> Take(Worker& self)
+		{
+			std::function<void()> task;
+			while (true)
+			{
+				if (PopBack(self, task) || PopFront(task) || Steal(self, task))
+				{
+					return task;
+				}
+				// the reserved task is being moved between queues (a thread exiting): try again
+				std::this_thread::yield();
+			}
+		}
+
+		static bool PopBack(Worker& worker, std::function<void()>& task)
+		{
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			if (worker.tasks.empty())
+			{
+				return false;
+			}
+			task = std::move(worker.tasks.back());
+			worker.tasks.pop_back();
+			return true;
+		}
+
+		bool PopFront(std::function<void()>& task)
+		{
+			std::lock_guard<std::mutex> lock(m_globalMutex);
+			if (m_global.empty())
+			{
+				return false;
+			}
+			task = std::move(m_global.front());
+			m_global.pop_front();
+			return true;
+		}
+
+		bool Steal(Worker& self, std::function<void()>& task)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto* victim : m_workers)
+			{
+				if (victim == &self)
+				{
+					continue;
+				}
+				std::lock_guard<std::mutex> victimLock(victim->mutex);
+				if (!victim->tasks.empty())
+				{
+					task = std::move(victim->tasks.front());
+					victim->tasks.pop_front();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void PinToCores() const
+		{
+#if defined(__linux__)
+			if (m_cores.empty())
+			{
+				return;
+			}
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (auto core : m_cores)
+			{
+				CPU_SET(core, &set);
+			}
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+		}
+
+		static constexpr std::chrono::seconds MaxIdleTime{ 30 };
+
+		const std::vector<unsigned> m_cores;
+		std::mutex m_mutex; // guards everything below but m_global
+		std::condition_variable m_taskAvailable;
+		std::condition_variable m_threadExited;
+		std::vector<Worker*> m_workers;
+		size_t m_queued = 0; // scheduled and not reserved by a thread yet
+		size_t m_idle = 0;
+		size_t m_threads = 0;
+		bool m_stopping = false;
+		std::mutex m_globalMutex;
+		std::deque<std::function<void()>> m_global;
+	};
+}
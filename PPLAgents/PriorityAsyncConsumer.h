@@ -0,0 +1,272 @@
+#pragma once
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "Agent.h"
+#include "AgentComposer.h"
+#include "DiscardTarget.h"
+
+namespace Agents
+{
+	namespace Details
+	{
+		template<typename Lanes>
+		struct LaneCount : std::tuple_size<Lanes>
+		{
+		};
+
+		template<typename Lane, size_t N>
+		struct LaneCount<Lane[N]> : std::integral_constant<size_t, N>
+		{
+		};
+
+		// lanes can be buffers or pointers to sources
+		template<typename T>
+		Concurrency::ISource<T>& SourceOf(Concurrency::ISource<T>& source)
+		{
+			return source;
+		}
+
+		template<typename T>
+		Concurrency::ISource<T>& SourceOf(Concurrency::ISource<T>* source)
+		{
+			return *source;
+		}
+
+		// same as SourceOf but keeping the type of the lane (e.g. BoundedBuffer, that the drain of last values can seal)
+		template<typename Lane>
+		Lane& LaneOf(Lane& lane)
+		{
+			return lane;
+		}
+
+		template<typename Lane>
+		Lane& LaneOf(Lane* lane)
+		{
+			return *lane;
+		}
+	}
+
+	// receives from "Lanes" sources until a cancellation is requested on "cancellation", like CancellableReceiver.
+	// Lane 0 has the highest priority: the next message is taken from the first lane having one
+	// (the same short-circuit make_choice gives to the cancellation over data).
+	// To not starve the others, a lane passed over "starvationLimit" times in a row (while higher lanes were served) gets a turn.
+	// Only when all the lanes are empty, a choice on the cancellation and all the lanes is built to block
+	template<typename T, size_t Lanes>
+	class PriorityReceiver
+	{
+	public:
+		PriorityReceiver(const std::array<Concurrency::ISource<T>*, Lanes>& lanes, CancellationToken& cancellation, size_t starvationLimit)
+			: m_lanes(lanes), m_cancellation(cancellation), m_starvationLimit(starvationLimit)
+		{
+
+		}
+
+		PriorityReceiver(const PriorityReceiver&) = delete;
+		PriorityReceiver& operator=(const PriorityReceiver&) = delete;
+
+		// returns true if a message has been received to "out" from "lane", false if a cancellation has been requested
+		bool Receive(size_t& lane, T& out)
+		{
+			while (!m_cancellation.IsCancellationRequested())
+			{
+				if (TryTake(lane, out) || Wait(lane, out, std::make_index_sequence<Lanes>{}))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// non-blocking: true if a message has been received to "out" from "lane" (never when a cancellation has been requested)
+		bool TryReceive(size_t& lane, T& out)
+		{
+			return !m_cancellation.IsCancellationRequested() && TryTake(lane, out);
+		}
+	private:
+		bool TryTake(size_t& lane, T& out)
+		{
+			for (size_t starving = 1; starving < Lanes; ++starving)
+			{
+				if (m_passedOver[starving] >= m_starvationLimit)
+				{
+					m_passedOver[starving] = 0;
+					if (TryTake(starving, lane, out))
+					{
+						return true;
+					}
+				}
+			}
+			for (size_t candidate = 0; candidate < Lanes; ++candidate)
+			{
+				if (TryTake(candidate, lane, out))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool TryTake(size_t candidate, size_t& lane, T& out)
+		{
+			if (!try_receive(*m_lanes[candidate], out))
+			{
+				return false;
+			}
+			Served(candidate);
+			lane = candidate;
+			return true;
+		}
+
+		// blocks until any lane (or the cancellation) has a message. False if cancelled or the message was taken by someone else
+		template<size_t... Lane>
+		bool Wait(size_t& lane, T& out, std::index_sequence<Lane...>)
+		{
+			auto messageSource = Concurrency::make_choice(&m_cancellation.m_target, m_lanes[Lane]...);
+			const auto messageIdx = receive(messageSource);
+			if (messageIdx == 0 || !messageSource.has_value())
+			{
+				return false;
+			}
+			out = messageSource.template value<T>();
+			lane = messageIdx - 1;
+			Served(lane);
+			return true;
+		}
+
+		void Served(size_t lane)
+		{
+			m_passedOver[lane] = 0;
+			for (auto lower = lane + 1; lower < Lanes; ++lower)
+			{
+				++m_passedOver[lower];
+			}
+		}
+
+		std::array<Concurrency::ISource<T>*, Lanes> m_lanes;
+		CancellationToken& m_cancellation;
+		size_t m_starvationLimit;
+		std::array<size_t, Lanes> m_passedOver{};
+	};
+
+	// An agent consuming from several prioritized sources ("lanes"), e.g. control and bulk messages, under one CancellationToken:
+	// control messages don't get stuck behind a large bulk backlog, without an agent (and a thread) per source.
+	// The Consumer is like the one of AsyncConsumerAgent, with "m_lanes" (an array of buffers or of source pointers,
+	// lane 0 is the highest priority) instead of "m_buffer":
+	//
+	// class MyConsumer
+	// {
+	// protected:
+	//    static constexpr size_t StarvationLimit = 16; // optional, default: DefaultStarvationLimit
+	//
+	//    void Consume(size_t lane, Command command)
+	//    {
+	//       ...
+	//    }
+	//
+	//    Concurrency::unbounded_buffer<Command> m_lanes[2]; // this name is mandatory: 0 is control, 1 is bulk
+	// };
+	//
+	// A lower lane is served anyway after StarvationLimit messages in a row from higher ones (see PriorityReceiver).
+	// Last values are processed lane by lane, in priority order, according to LastMessagesPolicy: its budget, if any (e.g. BoundedDrain), is for all the lanes.
+	// As with AsyncConsumerAgent, if Consume throws, the agent stops and its lanes are linked to a DiscardTarget owned by the agent
+	// (unlinked on destruction: lanes given as source pointers must outlive the agent)
+	//
+	// AgentComposer<PriorityAsyncConsumerAgent<MyConsumer>, AutoStart, AutoStopAndWait> agent;
+	template<typename Consumer, typename LastMessagesPolicy = Skills::RetainLastValues>
+	class PriorityAsyncConsumerAgent : public Consumer, public Agent
+	{
+	public:
+		using Consumer::Consumer;
+
+		~PriorityAsyncConsumerAgent()
+		{
+			if (m_discarding)
+			{
+				for (auto* lane : Lanes())
+				{
+					lane->unlink_target(&m_discard);
+				}
+			}
+		}
+
+		static constexpr size_t DefaultStarvationLimit = 32;
+
+		// messages discarded after Consume has thrown
+		[[nodiscard]] uint64_t DroppedMessages() const
+		{
+			return m_discard.Dropped();
+		}
+	protected:
+		void Run(CancellationToken& cancellationToken) override
+		{
+			try
+			{
+				ConsumeUntilCancelled(cancellationToken);
+				ProcessLastValues();
+			}
+			catch (const std::exception&)
+			{
+				m_discarding = true;
+				for (auto* lane : Lanes())
+				{
+					lane->link_target(&m_discard);
+				}
+			}
+		}
+
+		void ConsumeUntilCancelled(CancellationToken& cancellationToken)
+		{
+			constexpr auto starvationLimit = StarvationLimitOf<PriorityAsyncConsumerAgent>(nullptr);
+			static_assert(starvationLimit > 0, "StarvationLimit must be positive");
+
+			PriorityReceiver<payloadType, LaneCount> receiver{ Lanes(), cancellationToken, starvationLimit };
+			size_t lane = 0;
+			payloadType received{};
+			while (receiver.Receive(lane, received))
+			{
+				this->Consume(lane, Utils::Unwrap(std::move(received)));
+			}
+		}
+
+		void ProcessLastValues()
+		{
+			// the lane itself, not its ISource, so that the policy can seal and size it
+			auto laneAt = [this](size_t lane) -> auto& { return Details::LaneOf(this->m_lanes[lane]); };
+			Details::ProcessInOrder<LastMessagesPolicy>(laneAt, LaneCount, [this](size_t lane, auto&& val) {
+				this->Consume(lane, Utils::Unwrap(std::forward<decltype(val)>(val)));
+			});
+		}
+	private:
+		using payloadType = decltype(Utils::detect(Details::SourceOf(PriorityAsyncConsumerAgent::m_lanes[0])));
+		static constexpr size_t LaneCount = Details::LaneCount<std::remove_reference_t<decltype(PriorityAsyncConsumerAgent::m_lanes)>>::value;
+		static_assert(LaneCount > 0, "At least one lane is needed");
+
+		std::array<Concurrency::ISource<payloadType>*, LaneCount> Lanes()
+		{
+			std::array<Concurrency::ISource<payloadType>*, LaneCount> lanes{};
+			for (size_t lane = 0; lane < LaneCount; ++lane)
+			{
+				lanes[lane] = &Details::SourceOf(this->m_lanes[lane]);
+			}
+			return lanes;
+		}
+
+		// Consumer members might be protected, so detection happens here (where they are accessible)
+		template<typename Self>
+		static constexpr size_t StarvationLimitOf(decltype(Self::StarvationLimit)*)
+		{
+			return Self::StarvationLimit;
+		}
+
+		template<typename Self>
+		static constexpr size_t StarvationLimitOf(...)
+		{
+			return DefaultStarvationLimit;
+		}
+
+		DiscardTarget<payloadType> m_discard;
+		bool m_discarding = false; // written by Run, read on destruction (after Wait)
+	};
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "Agent.h"
+#include "AgentComposer.h"
+
+namespace Agents
+{
+	namespace Skills
+	{
+		// paces the consume loop of an AsyncConsumerAgent to at most Rate messages per second, with bursts of at most Burst messages
+		// (a token bucket of Burst tokens refilled at Rate tokens per second, full at the beginning):
+		//
+		// AgentComposer<AsyncConsumerAgent<QuoteClient>, RateLimited<100, 10>::Skill, AutoStart, AutoStopAndWait> agent{ buffer };
+		//
+		// - before Consume, the loop waits for a token cooperatively (like a Receive with a timeout: the context is not blocked),
+		//   with the precision of a millisecond (never accumulating: the schedule does not drift)
+		// - in batching mode, a batch takes as many tokens as its messages. A batch larger than Burst waits for a full bucket and
+		//   leaves it in debt, so the rate still holds on average
+		// - waiting ends as soon as a cancellation is requested: last values are not paced (DropLastValues or BoundedDrain bound them)
+		// - one bucket per agent, shared by all its loops (e.g. ParallelAsyncConsumerAgent), lock-free
+		// - ThrottledTime() reports the total time the loops have spent waiting for tokens
+		template<size_t Rate, size_t Burst = 1>
+		struct RateLimited
+		{
+			static_assert(Rate > 0, "Rate must be positive");
+			static_assert(Burst > 0, "Burst must be positive");
+
+			template<typename T>
+			struct Skill
+			{
+				// consume loop hook (see AgentComposer)
+				void OnBeforeConsume(size_t messages, CancellationToken& cancellationToken)
+				{
+					const auto now = Now();
+					const auto due = Reserve(messages, now);
+					const auto wait = (due - now) / 1'000'000; // rounded down: a reservation due in less than a millisecond doesn't wait
+					if (wait <= 0)
+					{
+						return;
+					}
+					Concurrency::unbounded_buffer<bool> never; // receiving from it is a sleep that a cancellation interrupts
+					CancellableReceiver<bool> pacing{ never, cancellationToken };
+					bool ignored = false;
+					(void)pacing.ReceiveFor(ignored, static_cast<unsigned>(wait));
+					m_throttled.fetch_add(Now() - now, std::memory_order_relaxed);
+				}
+
+				[[nodiscard]] std::chrono::nanoseconds ThrottledTime() const
+				{
+					return std::chrono::nanoseconds{ m_throttled.load(std::memory_order_relaxed) };
+				}
+			private:
+				static constexpr int64_t BurstNanoseconds = static_cast<int64_t>(Burst * 1'000'000'000ull / Rate);
+
+				static int64_t Now()
+				{
+					return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+				}
+
+				// takes "messages" tokens and returns when they are available (at most when the bucket is full, then it's left in debt)
+				int64_t Reserve(size_t messages, int64_t now)
+				{
+					const auto cost = static_cast<int64_t>(messages * 1'000'000'000ull / Rate);
+					auto emptied = m_emptied.load(std::memory_order_relaxed);
+					int64_t from;
+					do
+					{
+						// a bucket emptied in the past has been refilled (up to Burst) since then
+						from = emptied > now - BurstNanoseconds ? emptied : now - BurstNanoseconds;
+					} while (!m_emptied.compare_exchange_weak(emptied, from + cost, std::memory_order_relaxed));
+					return from + (cost < BurstNanoseconds ? cost : BurstNanoseconds);
+				}
+
+				std::atomic<int64_t> m_emptied = 0; // when the bucket is (or was) empty, given the tokens taken so far (nanoseconds)
+				std::atomic<int64_t> m_throttled = 0;
+			};
+		};
+	}
+}
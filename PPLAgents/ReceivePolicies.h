@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include "Agent.h"
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace Agents
+{
+	namespace Details
+	{
+		// tells the CPU this is a spin-wait loop (cheaper for the sibling hyper-thread, no memory-order speculation penalty)
+		inline void CpuRelax() noexcept
+		{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+			_mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#elif defined(__aarch64__)
+			asm volatile("yield");
+#else
+			std::this_thread::yield();
+#endif
+		}
+	}
+
+	namespace Skills
+	{
+		// policies to receive the next message in AsyncConsumerAgent (an instance for each consume loop), waiting up to "timeout"
+		// milliseconds (COOPERATIVE_TIMEOUT_INFINITE unless the Consumer has OnTick). A cancellation always wins over pending data.
+		// TryReceive is the non-blocking version (used to fill batches).
+		// "receiver" is a CancellableReceiver, or any receiver with the same interface (see MakeReceiver)
+
+		// blocks right away (on the choice between the buffer and the cancellation)
+		struct BlockingReceive
+		{
+			template<typename Receiver, typename T>
+			ReceiveResult Receive(Receiver& receiver, T& out, unsigned timeout = Concurrency::COOPERATIVE_TIMEOUT_INFINITE)
+			{
+				return receiver.ReceiveFor(out, timeout);
+			}
+
+			template<typename Receiver, typename T>
+			bool TryReceive(Receiver& receiver, T& out)
+			{
+				return receiver.TryReceive(out);
+			}
+		};
+
+		// Spins with try_receive for a short window before blocking: when messages arrive close to each other,
+		// the consumer gets the next one without paying the block/wake-up cost.
+		// The window adapts to the observed arrival rate:
+		// - it's twice the (moving) average time between messages
+		// - if that's more than MaxSpinMicroseconds, spinning would likely just burn CPU: the window is 0 (block right away)
+		// Spinning pauses the CPU for the first iterations, then yields the thread.
+		//
+		// AsyncConsumerAgent<MyConsumer, RetainLastValues, AdaptiveSpinReceive<50>> agent{ buffer };
+		template<unsigned MaxSpinMicroseconds = 50>
+		class AdaptiveSpinReceive
+		{
+		public:
+			template<typename Receiver, typename T>
+			ReceiveResult Receive(Receiver& receiver, T& out, unsigned timeout = Concurrency::COOPERATIVE_TIMEOUT_INFINITE)
+			{
+				if (receiver.TryReceive(out))
+				{
+					return Received(Clock::now());
+				}
+
+				const auto infinite = timeout == Concurrency::COOPERATIVE_TIMEOUT_INFINITE;
+				const auto start = Clock::now();
+				const auto window = infinite ? m_window : std::min<Clock::duration>(m_window, std::chrono::milliseconds(timeout));
+				if (window.count() > 0)
+				{
+					const auto deadline = start + window;
+					for (unsigned i = 0; !receiver.IsCancellationRequested(); ++i)
+					{
+						if (receiver.TryReceive(out))
+						{
+							return Received(Clock::now());
+						}
+						if (i < PausingIterations)
+						{
+							Details::CpuRelax();
+						}
+						else
+						{
+							std::this_thread::yield();
+						}
+						// the clock is read once in a while, that's not free either
+						if ((i & 15) == 15 && Clock::now() >= deadline)
+						{
+							break;
+						}
+					}
+				}
+
+				if (!infinite)
+				{
+					const auto spent = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+					timeout = spent < timeout ? timeout - static_cast<unsigned>(spent) : 0;
+				}
+				const auto result = receiver.ReceiveFor(out, timeout);
+				return result == ReceiveResult::Received ? Received(Clock::now()) : result;
+			}
+
+			template<typename Receiver, typename T>
+			bool TryReceive(Receiver& receiver, T& out)
+			{
+				return receiver.TryReceive(out);
+			}
+		private:
+			using Clock = std::chrono::steady_clock;
+
+			static constexpr unsigned PausingIterations = 64;
+			static constexpr auto MaxWindow = std::chrono::duration_cast<Clock::duration>(std::chrono::microseconds{ MaxSpinMicroseconds });
+
+			ReceiveResult Received(Clock::time_point now)
+			{
+				if (m_last != Clock::time_point{})
+				{
+					// exponential moving average (1/8 of the new gap)
+					m_averageGap += (now - m_last - m_averageGap) / 8;
+					const auto window = 2 * m_averageGap;
+					m_window = window <= MaxWindow ? window : Clock::duration::zero();
+				}
+				m_last = now;
+				return ReceiveResult::Received;
+			}
+
+			Clock::time_point m_last{};
+			Clock::duration m_averageGap = MaxWindow / 2;
+			Clock::duration m_window = MaxWindow;
+		};
+	}
+}
@@ -0,0 +1,497 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "AsyncConsumer.h"
+#include "PooledBuffer.h"
+
+namespace Agents
+{
+	// Serializer of trivially copyable payloads (their bytes, as they are): the default one of MessageRecorder and LogReplay.
+	// A Serializer of T has:
+	//
+	// static void Serialize(const T& value, std::vector<unsigned char>& out); // appends the bytes of "value" to "out"
+	// static T Deserialize(Utils::span<const unsigned char> bytes);
+	//
+	template<typename T>
+	struct TrivialSerializer
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "TrivialSerializer needs a trivially copyable T: give MessageRecorder a Serializer");
+
+		static void Serialize(const T& value, std::vector<unsigned char>& out)
+		{
+			const auto* bytes = reinterpret_cast<const unsigned char*>(&value);
+			out.insert(out.end(), bytes, bytes + sizeof(T));
+		}
+
+		static T Deserialize(Utils::span<const unsigned char> bytes)
+		{
+			if (bytes.size() != sizeof(T))
+			{
+				throw std::runtime_error("record size does not match the payload size");
+			}
+			T value;
+			std::memcpy(&value, bytes.data(), sizeof(T));
+			return value;
+		}
+	};
+
+	namespace Details
+	{
+		// Log layout: LogMagic, then a record per message:
+		// - nanoseconds since the recorder was created (uint64_t)
+		// - size of the serialized message + 1 (uint32_t): 0 ends the log (the zeros after the last record of a log not closed cleanly)
+		// - the serialized message
+		inline constexpr char LogMagic[8] = { 'P', 'P', 'L', 'A', 'L', 'O', 'G', '1' };
+		inline constexpr size_t LogRecordHeader = sizeof(uint64_t) + sizeof(uint32_t);
+
+		[[noreturn]] inline void ThrowLastError(const char* what)
+		{
+#if defined(_WIN32)
+			throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+#else
+			throw std::system_error(errno, std::generic_category(), what);
+#endif
+		}
+
+		// a file written only at its end through a memory mapping, that doubles when full.
+		// Flush writes back asynchronously what has been appended since the previous one; the file is trimmed to its content on destruction
+		class AppendOnlyMapping
+		{
+		public:
+			explicit AppendOnlyMapping(const std::string& path, size_t initialCapacity = size_t{ 1 } << 20)
+			{
+#if defined(_WIN32)
+				m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (m_file == INVALID_HANDLE_VALUE)
+				{
+					ThrowLastError("cannot create the log");
+				}
+#else
+				m_file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+				if (m_file < 0)
+				{
+					ThrowLastError("cannot create the log");
+				}
+				m_page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+				Map(initialCapacity);
+			}
+
+			AppendOnlyMapping(const AppendOnlyMapping&) = delete;
+			AppendOnlyMapping& operator=(const AppendOnlyMapping&) = delete;
+
+			~AppendOnlyMapping()
+			{
+				Unmap();
+#if defined(_WIN32)
+				LARGE_INTEGER size;
+				size.QuadPart = static_cast<LONGLONG>(m_size);
+				SetFilePointerEx(m_file, size, nullptr, FILE_BEGIN);
+				SetEndOfFile(m_file);
+				CloseHandle(m_file);
+#else
+				(void)ftruncate(m_file, static_cast<off_t>(m_size));
+				close(m_file);
+#endif
+			}
+
+			void Append(const void* data, size_t size)
+			{
+				if (m_size + size > m_capacity)
+				{
+					auto capacity = m_capacity * 2;
+					while (m_size + size > capacity)
+					{
+						capacity *= 2;
+					}
+					Unmap();
+					Map(capacity);
+				}
+				std::memcpy(m_data + m_size, data, size);
+				m_size += size;
+			}
+
+			void Flush()
+			{
+				if (m_flushed == m_size)
+				{
+					return;
+				}
+#if defined(_WIN32)
+				FlushViewOfFile(m_data + m_flushed, m_size - m_flushed);
+#else
+				const auto from = m_flushed / m_page * m_page; // msync wants the address aligned to a page
+				msync(m_data + from, m_size - from, MS_ASYNC);
+#endif
+				m_flushed = m_size;
+			}
+
+			[[nodiscard]] size_t Size() const
+			{
+				return m_size;
+			}
+		private:
+			void Map(size_t capacity)
+			{
+#if defined(_WIN32)
+				const auto size = static_cast<unsigned long long>(capacity);
+				m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+				if (!m_mapping)
+				{
+					ThrowLastError("cannot map the log");
+				}
+				m_data = static_cast<unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, capacity));
+				if (!m_data)
+				{
+					ThrowLastError("cannot map the log");
+				}
+#else
+				if (ftruncate(m_file, static_cast<off_t>(capacity)) != 0)
+				{
+					ThrowLastError("cannot grow the log");
+				}
+				auto* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+				if (data == MAP_FAILED)
+				{
+					ThrowLastError("cannot map the log");
+				}
+				m_data = static_cast<unsigned char*>(data);
+#endif
+				m_capacity = capacity;
+			}
+
+			void Unmap()
+			{
+				if (!m_data)
+				{
+					return;
+				}
+				Flush();
+#if defined(_WIN32)
+				UnmapViewOfFile(m_data);
+				CloseHandle(m_mapping);
+				m_mapping = nullptr;
+#else
+				munmap(m_data, m_capacity);
+#endif
+				m_data = nullptr;
+			}
+
+#if defined(_WIN32)
+			HANDLE m_file = INVALID_HANDLE_VALUE;
+			HANDLE m_mapping = nullptr;
+#else
+			int m_file = -1;
+			size_t m_page = 4096;
+#endif
+			unsigned char* m_data = nullptr;
+			size_t m_capacity = 0;
+			size_t m_size = 0;
+			size_t m_flushed = 0;
+		};
+
+		// a whole file mapped for reading
+		class ReadOnlyMapping
+		{
+		public:
+			explicit ReadOnlyMapping(const std::string& path)
+			{
+#if defined(_WIN32)
+				m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (m_file == INVALID_HANDLE_VALUE)
+				{
+					ThrowLastError("cannot open the log");
+				}
+				LARGE_INTEGER size;
+				if (!GetFileSizeEx(m_file, &size))
+				{
+					ThrowLastError("cannot open the log");
+				}
+				m_size = static_cast<size_t>(size.QuadPart);
+				if (m_size)
+				{
+					m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+					m_data = m_mapping ? static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+					if (!m_data)
+					{
+						ThrowLastError("cannot map the log");
+					}
+				}
+#else
+				m_file = open(path.c_str(), O_RDONLY);
+				struct stat status;
+				if (m_file < 0 || fstat(m_file, &status) != 0)
+				{
+					ThrowLastError("cannot open the log");
+				}
+				m_size = static_cast<size_t>(status.st_size);
+				if (m_size)
+				{
+					auto* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+					if (data == MAP_FAILED)
+					{
+						ThrowLastError("cannot map the log");
+					}
+					m_data = static_cast<const unsigned char*>(data);
+				}
+#endif
+			}
+
+			ReadOnlyMapping(const ReadOnlyMapping&) = delete;
+			ReadOnlyMapping& operator=(const ReadOnlyMapping&) = delete;
+
+			~ReadOnlyMapping()
+			{
+#if defined(_WIN32)
+				if (m_data)
+				{
+					UnmapViewOfFile(m_data);
+				}
+				if (m_mapping)
+				{
+					CloseHandle(m_mapping);
+				}
+				if (m_file != INVALID_HANDLE_VALUE)
+				{
+					CloseHandle(m_file);
+				}
+#else
+				if (m_data)
+				{
+					munmap(const_cast<unsigned char*>(m_data), m_size);
+				}
+				if (m_file >= 0)
+				{
+					close(m_file);
+				}
+#endif
+			}
+
+			[[nodiscard]] Utils::span<const unsigned char> Bytes() const
+			{
+				return { m_data, m_size };
+			}
+		private:
+#if defined(_WIN32)
+			HANDLE m_file = INVALID_HANDLE_VALUE;
+			HANDLE m_mapping = nullptr;
+#else
+			int m_file = -1;
+#endif
+			const unsigned char* m_data = nullptr;
+			size_t m_size = 0;
+		};
+	}
+
+	// Appends the messages it's given to a memory-mapped, append-only log (to replay them with LogReplay, see also Skills::Recorded).
+	// Record (thread-safe) only copies the message, with the time, into a PooledBuffer: a background AsyncConsumerAgent serializes
+	// batches of them (up to MaxBatchSize) into the log and flushes after each batch. Messages recorded before destruction are all written.
+	template<typename T, typename Serializer = TrivialSerializer<T>>
+	class MessageRecorder
+	{
+	public:
+		static constexpr size_t MaxBatchSize = 256;
+
+		explicit MessageRecorder(const std::string& path)
+			: m_log(path), m_start(std::chrono::steady_clock::now())
+		{
+			m_log.Append(Details::LogMagic, sizeof(Details::LogMagic));
+		}
+
+		void Record(const T& message)
+		{
+			const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+			Send(m_writer.Buffer(), Entry{ static_cast<uint64_t>(time), message });
+		}
+
+		// messages written to the log so far
+		[[nodiscard]] uint64_t Recorded() const
+		{
+			return m_writer.Written();
+		}
+	private:
+		struct Entry
+		{
+			uint64_t Time = 0;
+			T Message{};
+		};
+
+		class Writer
+		{
+		public:
+			explicit Writer(Details::AppendOnlyMapping& log)
+				: m_log(log)
+			{
+
+			}
+
+			[[nodiscard]] uint64_t Written() const
+			{
+				return m_written.load(std::memory_order_relaxed);
+			}
+
+			static constexpr size_t MaxBatchSize = MessageRecorder::MaxBatchSize;
+		protected:
+			void ConsumeBatch(Utils::span<Entry> entries)
+			{
+				m_bytes.clear();
+				for (const auto& entry : entries)
+				{
+					const auto header = m_bytes.size();
+					m_bytes.resize(header + Details::LogRecordHeader);
+					Serializer::Serialize(entry.Message, m_bytes);
+					const auto size = static_cast<uint32_t>(m_bytes.size() - header - Details::LogRecordHeader + 1);
+					std::memcpy(m_bytes.data() + header, &entry.Time, sizeof(entry.Time));
+					std::memcpy(m_bytes.data() + header + sizeof(entry.Time), &size, sizeof(size));
+				}
+				m_log.Append(m_bytes.data(), m_bytes.size());
+				m_log.Flush();
+				m_written.fetch_add(entries.size(), std::memory_order_relaxed);
+			}
+
+			PooledBuffer<Entry> m_buffer;
+		private:
+			Details::AppendOnlyMapping& m_log;
+			std::vector<unsigned char> m_bytes; // one batch, appended at once
+			std::atomic<uint64_t> m_written = 0;
+		};
+
+		Details::AppendOnlyMapping m_log;
+		std::chrono::steady_clock::time_point m_start;
+		// destroyed first: what's pending is written (RetainLastValues) before the log is closed
+		AgentComposer<AsyncConsumerAgent<Writer>, Skills::AutoStart, Skills::AutoStopAndWait> m_writer{ m_log };
+	};
+
+	enum class ReplaySpeed
+	{
+		Original, // each message is sent when, since the replay started, as much time has passed as when it was recorded
+		Maximum // as fast as possible
+	};
+
+	// Streams a log written by MessageRecorder into "target" (e.g. the unbounded_buffer a consumer receives from).
+	// It's an Agent: Stop cuts the replay short (also while waiting for the next message at ReplaySpeed::Original).
+	// The log is opened (and checked) on construction, a log not closed cleanly is replayed up to its last complete record
+	//
+	// Concurrency::unbounded_buffer<Trade> buffer;
+	// LogReplay<Trade> replay{ "trades.log", buffer, ReplaySpeed::Original };
+	// replay.Start();
+	// replay.Wait();
+	//
+	template<typename T, typename Serializer = TrivialSerializer<T>>
+	class LogReplay : public Agent
+	{
+	public:
+		LogReplay(const std::string& path, Concurrency::ITarget<T>& target, ReplaySpeed speed = ReplaySpeed::Maximum)
+			: m_log(path), m_target(target), m_speed(speed)
+		{
+			const auto bytes = m_log.Bytes();
+			if (bytes.size() < sizeof(Details::LogMagic) || std::memcmp(bytes.data(), Details::LogMagic, sizeof(Details::LogMagic)) != 0)
+			{
+				throw std::runtime_error("not a message log: " + path);
+			}
+		}
+
+		// messages sent to the target so far
+		[[nodiscard]] uint64_t Replayed() const
+		{
+			return m_replayed.load(std::memory_order_relaxed);
+		}
+	protected:
+		void Run(CancellationToken& cancellationToken) override
+		{
+			// nothing is ever sent here: receiving from it is a sleep that a cancellation interrupts
+			Concurrency::unbounded_buffer<bool> never;
+			CancellableReceiver<bool> pacing{ never, cancellationToken };
+			const auto bytes = m_log.Bytes();
+			const auto start = std::chrono::steady_clock::now();
+			auto offset = sizeof(Details::LogMagic);
+			while (offset + Details::LogRecordHeader <= bytes.size() && !cancellationToken.IsCancellationRequested())
+			{
+				uint64_t time = 0;
+				uint32_t size = 0;
+				std::memcpy(&time, bytes.data() + offset, sizeof(time));
+				std::memcpy(&size, bytes.data() + offset + sizeof(time), sizeof(size));
+				offset += Details::LogRecordHeader;
+				if (size == 0 || offset + size - 1 > bytes.size())
+				{
+					return;
+				}
+				auto message = Serializer::Deserialize({ bytes.data() + offset, size - size_t{ 1 } });
+				offset += size - 1;
+
+				if (m_speed == ReplaySpeed::Original && !WaitUntil(pacing, start + std::chrono::nanoseconds(time)))
+				{
+					return;
+				}
+				send(m_target, message);
+				m_replayed.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	private:
+		// false if a cancellation is requested first. Waits in whole milliseconds: a message due in less is sent right away
+		// (the schedule is relative to the start, so this doesn't accumulate)
+		static bool WaitUntil(CancellableReceiver<bool>& pacing, std::chrono::steady_clock::time_point due)
+		{
+			const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(due - std::chrono::steady_clock::now()).count();
+			bool ignored = false;
+			return wait <= 0 || pacing.ReceiveFor(ignored, static_cast<unsigned>(wait)) != ReceiveResult::Cancelled;
+		}
+
+		Details::ReadOnlyMapping m_log;
+		Concurrency::ITarget<T>& m_target;
+		ReplaySpeed m_speed;
+		std::atomic<uint64_t> m_replayed = 0;
+	};
+
+	namespace Skills
+	{
+		// records the messages of an AsyncConsumerAgent (as received, before Consume) while a MessageRecorder is attached.
+		// The recorder must outlive the agent (or be detached while the agent is not running):
+		//
+		// MessageRecorder<Trade> recorder{ "trades.log" };
+		// AgentComposer<AsyncConsumerAgent<MyConsumer>, Recorded<Trade>::Skill, AutoStart, AutoStopAndWait> agent{ buffer };
+		// agent.RecordTo(&recorder);
+		// ...
+		// agent.RecordTo(nullptr);
+		//
+		template<typename T, typename Serializer = TrivialSerializer<T>>
+		struct Recorded
+		{
+			template<typename Agent>
+			struct Skill
+			{
+				void RecordTo(MessageRecorder<T, Serializer>* recorder)
+				{
+					m_recorder.store(recorder, std::memory_order_release);
+				}
+
+				// consume loop hook (see AgentComposer)
+				void OnMessage(const T& message)
+				{
+					if (auto* recorder = m_recorder.load(std::memory_order_acquire))
+					{
+						recorder->Record(message);
+					}
+				}
+			private:
+				std::atomic<MessageRecorder<T, Serializer>*> m_recorder = nullptr;
+			};
+		};
+	}
+}
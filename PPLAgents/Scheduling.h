@@ -0,0 +1,122 @@
+#pragma once
+#include <optional>
+#include <thread>
+#include <vector>
+#include "Backend.h"
+#include "Utils.h"
+
+namespace Agents
+{
+	struct SchedulerOptions
+	{
+		unsigned Cores = 0; // how many cores the scheduler uses (0: all of them)
+		std::optional<unsigned> FirstCore; // if set, threads only run on cores [FirstCore, FirstCore + Cores) (portable backend only)
+	};
+
+	// A scheduler instance agents can be started on (see Agent::SetScheduler and Skills::ScheduledOn), instead of the default one.
+	// Useful to keep the hot agents (e.g. of one pipeline) on a few cores and background agents away from them:
+	//
+	// Scheduler hot{ { 4, 0 } }; // cores 0-3
+	// Scheduler background{ { 2, 4 } }; // cores 4-5
+	// Scheduler any{ { 2, std::nullopt } }; // 2 cores
+	//
+	// Agents started by an agent running on a scheduler stay on that scheduler.
+	// - ConcRT: a Concurrency::Scheduler with Cores virtual processors, favoring the locality of its tasks (already work-stealing)
+	// - portable backend: an Agents::Portable::Scheduler (per thread work-stealing queues), pinned to the cores (Linux only).
+	//   Without FirstCore, the cores are the first Cores the process is allowed to run on. The number of threads is not capped:
+	//   agents block their thread while receiving (there are no cooperative contexts), so capping it could deadlock them
+	//
+	// A scheduler must outlive the agents started on it
+	class Scheduler
+	{
+	public:
+		explicit Scheduler(const SchedulerOptions& options = {})
+#if defined(PPLAGENTS_PORTABLE_BACKEND)
+			: m_scheduler(CoresOf(options))
+#else
+			: m_scheduler(Concurrency::Scheduler::Create(PolicyOf(options)))
+#endif
+		{
+
+		}
+
+		Scheduler(const Scheduler&) = delete;
+		Scheduler& operator=(const Scheduler&) = delete;
+
+		~Scheduler()
+		{
+#if !defined(PPLAGENTS_PORTABLE_BACKEND)
+			m_scheduler->Release();
+#endif
+		}
+
+		// calls "action" with this as the current scheduler of the calling thread: agents started meanwhile run on it
+		template<typename Action>
+		void Attached(Action action)
+		{
+#if defined(PPLAGENTS_PORTABLE_BACKEND)
+			auto* previous = m_scheduler.Attach();
+			Utils::defer detachGuard([=] { Concurrency::Scheduler::Detach(previous); });
+#else
+			m_scheduler->Attach();
+			Utils::defer detachGuard([] { Concurrency::CurrentScheduler::Detach(); });
+#endif
+			action();
+		}
+	private:
+#if defined(PPLAGENTS_PORTABLE_BACKEND)
+		static std::vector<unsigned> CoresOf(const SchedulerOptions& options)
+		{
+			std::vector<unsigned> cores;
+			if (options.FirstCore)
+			{
+				const auto count = options.Cores ? options.Cores : std::thread::hardware_concurrency();
+				for (auto core = *options.FirstCore; core < *options.FirstCore + count; ++core)
+				{
+					cores.push_back(core);
+				}
+			}
+			else if (options.Cores)
+			{
+				cores = Concurrency::Scheduler::AllowedCores();
+				// as many as the process has (or more) is all of them: no pinning
+				cores.resize(cores.size() > options.Cores ? options.Cores : 0);
+			}
+			return cores;
+		}
+
+		Concurrency::Scheduler m_scheduler;
+#else
+		static Concurrency::SchedulerPolicy PolicyOf(const SchedulerOptions& options)
+		{
+			const auto cores = options.Cores ? options.Cores : Concurrency::GetProcessorCount();
+			return Concurrency::SchedulerPolicy(3,
+				Concurrency::MinConcurrency, cores,
+				Concurrency::MaxConcurrency, cores,
+				Concurrency::SchedulingProtocol, Concurrency::EnhanceScheduleGroupLocality);
+		}
+
+		Concurrency::Scheduler* m_scheduler;
+#endif
+	};
+
+	namespace Skills
+	{
+		// starts the agent on Provider::Instance(). The scheduler is set once the whole agent is constructed (see OnComposed),
+		// so place it before AutoStart:
+		// struct HotCores { static Scheduler& Instance() { static Scheduler scheduler{ { 4, 0 } }; return scheduler; } };
+		// AgentComposer<AsyncConsumerAgent<MyConsumer>, ScheduledOn<HotCores>::Skill, AutoStart, AutoStopAndWait> agent{ buffer };
+		template<typename Provider>
+		struct ScheduledOn
+		{
+			template<typename T>
+			struct Skill
+			{
+				void OnComposed()
+				{
+					static_cast<T&>(*this).SetScheduler(Provider::Instance());
+				}
+			};
+		};
+	}
+}
@@ -0,0 +1,333 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include "Agent.h"
+
+namespace Agents
+{
+	// A single-producer/single-consumer buffer: when exactly one context sends and exactly one receives (e.g. the only producer of an
+	// AsyncConsumerAgent), it replaces an unbounded_buffer without its locks and propagation protocol.
+	// It can be a Consumer m_buffer (AsyncConsumerAgent receives with SpscReceiver), but it's not a message block:
+	// it can't be linked to other blocks nor used with Concurrency::receive or choice.
+	//
+	// - unbounded, like unbounded_buffer: values are stored in rings of SegmentSize slots and a new ring is added when the last one is full
+	//   (the last ring emptied is kept for reuse, so a steady flow doesn't allocate)
+	// - Send is a store and an atomic increment, plus a wake-up only if the consumer is blocked waiting
+	// - producer and consumer indexes live on different cache lines
+	// - not for ParallelAsyncConsumerAgent (more than one consumer) nor for more than one producer
+	// - once sealed (by the drain of last values, see Details::SealBacklog), Send rejects values: it returns false and Rejected() counts them
+	//
+	// class MyConsumer
+	// {
+	// protected:
+	//    void Consume(int value);
+	//    SpscBuffer<int> m_buffer;
+	// };
+	//
+	// Send(agent.Buffer(), 42); // always from the same context
+	//
+	template<typename T, size_t SegmentSize = (std::max)(size_t{ 32 }, size_t{ 16384 } / sizeof(T))>
+	class SpscBuffer : public Utils::DirectSource<T>
+	{
+		static_assert(SegmentSize > 0, "SegmentSize must be positive");
+	public:
+		SpscBuffer()
+			: m_producer{ new Segment }, m_consumer{ m_producer.Current }
+		{
+
+		}
+
+		SpscBuffer(const SpscBuffer&) = delete;
+		SpscBuffer& operator=(const SpscBuffer&) = delete;
+
+		~SpscBuffer()
+		{
+			T ignored{};
+			while (TryReceive(ignored))
+			{
+			}
+			delete m_consumer.Current;
+			delete m_spare.load(std::memory_order_relaxed);
+		}
+
+		// producer side: false if the buffer is sealed
+		bool Send(T value)
+		{
+			if (m_sealed.load(std::memory_order_relaxed))
+			{
+				m_rejected.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			if (auto* target = m_target.load(std::memory_order_acquire))
+			{
+				return send(*target, value);
+			}
+			Push(std::move(value));
+			// pairs with the fence in Wait: either the consumer sees the value or this sees the consumer waiting
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_waiting.load(std::memory_order_relaxed) && m_waiting.exchange(false, std::memory_order_acq_rel))
+			{
+				asend(m_wakeUp, true);
+			}
+			return true;
+		}
+
+		// consumer side
+		bool TryReceive(T& out)
+		{
+			if (m_consumer.Tail == m_consumer.Head)
+			{
+				m_consumer.Tail = m_tail.load(std::memory_order_acquire);
+				if (m_consumer.Tail == m_consumer.Head)
+				{
+					return false;
+				}
+			}
+			if (m_consumer.Index == SegmentSize)
+			{
+				auto* emptied = std::exchange(m_consumer.Current, m_consumer.Current->Next);
+				m_consumer.Index = 0;
+				delete m_spare.exchange(emptied, std::memory_order_acq_rel);
+			}
+			auto& slot = m_consumer.Current->Slots[m_consumer.Index++];
+			out = std::move(*slot.Value());
+			slot.Value()->~T();
+			m_head.store(++m_consumer.Head, std::memory_order_release);
+			return true;
+		}
+
+		// number of messages in the buffer (pending)
+		[[nodiscard]] size_t Size() const
+		{
+			const auto head = m_head.load(std::memory_order_acquire);
+			return static_cast<size_t>(m_tail.load(std::memory_order_acquire) - head);
+		}
+
+		// rejects the values sent from now on (it can't be undone). A value being sent while sealing might still get in
+		void Seal()
+		{
+			m_sealed.store(true, std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] bool IsSealed() const
+		{
+			return m_sealed.load(std::memory_order_relaxed);
+		}
+
+		// values rejected because the buffer was sealed
+		[[nodiscard]] size_t Rejected() const
+		{
+			return m_rejected.load(std::memory_order_relaxed);
+		}
+
+		// consumer side: what's pending and what is sent afterwards goes to "target" (see AsyncConsumerAgent::DiscardIncomingMessages).
+		// A value sent while linking might stay in the buffer: it's given to "target" by unlink_target
+		void link_target(Concurrency::ITarget<T>* target)
+		{
+			m_target.store(target, std::memory_order_release);
+			Forward(*target);
+		}
+
+		// consumer side, once the producer is done
+		void unlink_target(Concurrency::ITarget<T>* target)
+		{
+			Forward(*target);
+			m_target.store(nullptr, std::memory_order_release);
+		}
+	private:
+		template<typename U>
+		friend class SpscReceiver;
+
+		struct Slot
+		{
+			T* Value() noexcept
+			{
+				return std::launder(reinterpret_cast<T*>(Storage));
+			}
+
+			alignas(T) unsigned char Storage[sizeof(T)];
+		};
+
+		struct Segment
+		{
+			Slot Slots[SegmentSize];
+			Segment* Next = nullptr; // written before the first value of the next segment is published
+		};
+
+		// the consumer blocked on an empty buffer: Received if there might be data (woken up by Send, possibly spuriously),
+		// otherwise the result of "receiver" (cancelled or "timeout" expired)
+		ReceiveResult Wait(CancellableReceiver<bool>& receiver, unsigned timeout)
+		{
+			m_waiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_tail.load(std::memory_order_relaxed) != m_consumer.Head)
+			{
+				// if Send has already taken the flag, the wake-up stays in m_wakeUp (just a spurious one next time)
+				m_waiting.store(false, std::memory_order_relaxed);
+				return ReceiveResult::Received;
+			}
+			bool ignored = false;
+			const auto result = receiver.ReceiveFor(ignored, timeout);
+			m_waiting.store(false, std::memory_order_relaxed);
+			return result;
+		}
+
+		void Push(T&& value)
+		{
+			if (m_producer.Index == SegmentSize)
+			{
+				auto* next = m_spare.exchange(nullptr, std::memory_order_acq_rel);
+				if (next)
+				{
+					next->Next = nullptr;
+				}
+				else
+				{
+					next = new Segment;
+				}
+				m_producer.Current->Next = next;
+				m_producer.Current = next;
+				m_producer.Index = 0;
+			}
+			new (m_producer.Current->Slots[m_producer.Index++].Storage) T(std::move(value));
+			m_tail.store(++m_producer.Tail, std::memory_order_release);
+		}
+
+		void Forward(Concurrency::ITarget<T>& target)
+		{
+			T value{};
+			while (TryReceive(value))
+			{
+				send(target, value);
+			}
+		}
+
+		// only the producer touches it
+		struct alignas(64) ProducerSide
+		{
+			Segment* Current;
+			size_t Index = 0;
+			uint64_t Tail = 0;
+		};
+
+		// only the consumer touches it
+		struct alignas(64) ConsumerSide
+		{
+			Segment* Current;
+			size_t Index = 0;
+			uint64_t Head = 0;
+			uint64_t Tail = 0; // last m_tail seen: the shared line is read only when this one is exhausted
+		};
+
+		ProducerSide m_producer;
+		ConsumerSide m_consumer;
+		alignas(64) std::atomic<uint64_t> m_tail = 0; // values sent, written by the producer
+		alignas(64) std::atomic<uint64_t> m_head = 0; // values received, written by the consumer (for Size)
+		alignas(64) std::atomic<bool> m_waiting = false;
+		std::atomic<Segment*> m_spare = nullptr;
+		std::atomic<Concurrency::ITarget<T>*> m_target = nullptr;
+		std::atomic<bool> m_sealed = false;
+		std::atomic<size_t> m_rejected = 0;
+		Concurrency::unbounded_buffer<bool> m_wakeUp;
+	};
+
+	// producer side, like Agents::Send on a BoundedBuffer (false if "target" is sealed)
+	template<typename T, size_t SegmentSize>
+	bool Send(SpscBuffer<T, SegmentSize>& target, T value)
+	{
+		return target.Send(std::move(value));
+	}
+
+	// consumer side, just like Concurrency::try_receive (also used by the LastMessagesPolicy skills)
+	template<typename T, size_t SegmentSize>
+	bool try_receive(SpscBuffer<T, SegmentSize>& source, T& out)
+	{
+		return source.TryReceive(out);
+	}
+
+	// receives from a SpscBuffer until a cancellation is requested, like CancellableReceiver:
+	// a cancellation already requested wins over pending data and blocking happens only when the buffer is empty
+	template<typename Buffer>
+	class SpscReceiver
+	{
+		using T = decltype(Utils::detect(std::declval<Buffer&>()));
+	public:
+		SpscReceiver(Buffer& source, CancellationToken& cancellation)
+			: m_source(source), m_cancellation(cancellation), m_wakeUps(source.m_wakeUp, cancellation)
+		{
+
+		}
+
+		SpscReceiver(const SpscReceiver&) = delete;
+		SpscReceiver& operator=(const SpscReceiver&) = delete;
+
+		// returns true if a message has been received to "out", false if a cancellation has been requested.
+		// If "timeout" expires, throws Concurrency::operation_timed_out (ReceiveFor does not throw)
+		bool Receive(T& out, unsigned timeout = Concurrency::COOPERATIVE_TIMEOUT_INFINITE)
+		{
+			const auto result = ReceiveFor(out, timeout);
+			if (result == ReceiveResult::TimedOut)
+			{
+				throw Concurrency::operation_timed_out();
+			}
+			return result == ReceiveResult::Received;
+		}
+
+		ReceiveResult ReceiveFor(T& out, unsigned timeout)
+		{
+			const auto infinite = timeout == Concurrency::COOPERATIVE_TIMEOUT_INFINITE;
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(infinite ? 0 : timeout);
+			while (!m_cancellation.IsCancellationRequested())
+			{
+				if (m_source.TryReceive(out))
+				{
+					return ReceiveResult::Received;
+				}
+
+				auto wait = timeout;
+				if (!infinite)
+				{
+					const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+					if (remaining.count() <= 0)
+					{
+						return ReceiveResult::TimedOut;
+					}
+					wait = static_cast<unsigned>(remaining.count());
+				}
+				// woken up (even spuriously): try again
+				const auto result = m_source.Wait(m_wakeUps, wait);
+				if (result != ReceiveResult::Received)
+				{
+					return result;
+				}
+			}
+			return ReceiveResult::Cancelled;
+		}
+
+		// non-blocking: true if a message has been received to "out" (never when a cancellation has been requested)
+		bool TryReceive(T& out)
+		{
+			return !m_cancellation.IsCancellationRequested() && m_source.TryReceive(out);
+		}
+
+		[[nodiscard]] bool IsCancellationRequested() const
+		{
+			return m_cancellation.IsCancellationRequested();
+		}
+	private:
+		Buffer& m_source;
+		CancellationToken& m_cancellation;
+		CancellableReceiver<bool> m_wakeUps;
+	};
+
+	template<typename T, size_t SegmentSize>
+	SpscReceiver<SpscBuffer<T, SegmentSize>> MakeReceiver(SpscBuffer<T, SegmentSize>& source, CancellationToken& cancellation)
+	{
+		return { source, cancellation };
+	}
+}
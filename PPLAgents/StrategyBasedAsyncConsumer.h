@@ -1,4 +1,7 @@
 #pragma once
+#include <functional>
+#include <memory>
+#include <type_traits>
 #include "AsyncConsumer.h"
 
 namespace Agents
@@ -14,12 +17,28 @@ namespace Agents
 		virtual void Consume(const T&) = 0;
 	};
 
+	// same as IAsyncConsumerStrategy but taking ownership of the values (e.g. to keep them without a copy, or move-only types).
+	// Only the rvalue overload is virtual, so each message costs a single indirect call as well
+	template<typename T>
+	class IMovingAsyncConsumerStrategy
+	{
+	public:
+		virtual ~IMovingAsyncConsumerStrategy() = default;
+		virtual void Consume(T&&) = 0;
+
+		// not virtual: consumes a copy of "value"
+		void Consume(const T& value)
+		{
+			Consume(T{ value });
+		}
+	};
+
 	template<typename T>
 	class CallableConsumerStrategy : public IAsyncConsumerStrategy<T>
 	{
 	public:
 		explicit CallableConsumerStrategy(std::function<void(const T&)> action)
-			: m_action(action)
+			: m_action(std::move(action))
 		{
 			
 		}
@@ -32,30 +51,58 @@ namespace Agents
 		std::function<void(const T&)> m_action;
 	};
 
-	// This is the consumer that AsyncConsumer will be based on
-	template<typename T>
+	// This is the consumer that AsyncConsumer will be based on.
+	// "Strategy" can be either:
+	// - a pointer-like to IAsyncConsumerStrategy<T> (default): the strategy is polymorphic (e.g. for plugins),
+	//   or to IMovingAsyncConsumerStrategy<T> to move the values into it
+	// - any callable accepting T: the strategy is known at compile time, so it's called directly
+	//   (no virtual call, no std::function, the hot loop can inline it)
+	template<typename T, typename Strategy = std::unique_ptr<IAsyncConsumerStrategy<T>>>
 	class ConsumerWithStrategy
 	{
 	public:
-		ConsumerWithStrategy(Concurrency::ISource<T>& src, std::unique_ptr<IAsyncConsumerStrategy<T>> strategy)
+		ConsumerWithStrategy(Concurrency::ISource<T>& src, Strategy strategy)
 			: m_buffer(src), m_strategy(std::move(strategy))
 		{
 
 		}
 	protected:
-		void Consume(T val)
+		void Consume(const T& val)
+		{
+			Invoke(val);
+		}
+
+		void Consume(T&& val)
 		{
-			m_strategy->Consume(val);
+			Invoke(std::move(val));
 		}
 
 		Concurrency::ISource<T>& m_buffer;
 	private:
-		std::unique_ptr<IAsyncConsumerStrategy<T>> m_strategy;
+		template<typename U>
+		void Invoke(U&& val)
+		{
+			if constexpr (std::is_invocable_v<Strategy&, U&&>)
+			{
+				m_strategy(std::forward<U>(val));
+			}
+			else
+			{
+				m_strategy->Consume(std::forward<U>(val));
+			}
+		}
+
+		Strategy m_strategy;
 	};
 
 	// create other versions of this if you need to customize any of Start, Stop, Wait or LastValue policies
-	template<typename T>
-	using StrategyBasedAsyncConsumer = AsyncConsumer<ConsumerWithStrategy<T>,
+	//
+	// polymorphic:
+	// StrategyBasedAsyncConsumer<std::string> consumer{ strings, std::make_unique<CallableConsumerStrategy<std::string>>(action) };
+	// compile-time:
+	// StrategyBasedAsyncConsumer<std::string, decltype(action)> consumer{ strings, action };
+	template<typename T, typename Strategy = std::unique_ptr<IAsyncConsumerStrategy<T>>>
+	using StrategyBasedAsyncConsumer = AsyncConsumer<ConsumerWithStrategy<T, Strategy>,
 		Skills::AutoStart,
 		Skills::AutoStop,
 		Skills::AutoWait,
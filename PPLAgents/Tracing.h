@@ -0,0 +1,514 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if defined(PPLAGENTS_TRACING) && defined(_WIN32)
+#include <windows.h>
+#include <evntprov.h>
+#include <cwchar>
+#if defined(_MSC_VER)
+#pragma comment(lib, "advapi32.lib")
+#endif
+#endif
+
+// Tracing of agent lifecycles and message hops, compiled in only if PPLAGENTS_TRACING is defined (otherwise every trace point is empty).
+// Compiled in, it's off until Tracing::Enable: then a trace point is a single branch (a relaxed atomic load).
+// PPLAGENTS_TRACING must be the same for every translation unit of a program (define it for the whole build, e.g. with the CMake
+// option PPLAGENTS_TRACING, not in a source file): inline functions compiled both ways would break the one definition rule.
+//
+// Tracing::Enable();
+// Tracing::SetName(&orders, "orders");
+// ...
+// Tracing::ExportChromeTrace("trace.json"); // to open with chrome://tracing or https://ui.perfetto.dev
+//
+// - Agent: Start, Stop and Complete (instants) and Run (span); AsyncConsumerAgent (and those built on it): Receive (the time spent
+//   waiting for a message) and Consume spans, with the number of messages consumed
+// - flows: Tracing::FlowOut(id) where a message is sent and Tracing::FlowIn(id) (or Skills::TracedFlow) where it's received
+//   connect the two spans, e.g. the stages of a pipeline
+// - events are written to a ring per thread (no lock, the oldest events are overwritten) and collected by Collect or the export,
+//   also while agents are running
+// - on Windows, events are also written to ETW (manifest-free strings) while a session has enabled the provider
+//   {B8A0C2E4-5D1F-4E7A-9C3B-2F6D8E1A4C70}, e.g. xperf -start PPLAgents -on B8A0C2E4-5D1F-4E7A-9C3B-2F6D8E1A4C70
+namespace Agents
+{
+	class Agent;
+}
+
+namespace Agents::Tracing
+{
+	enum class EventType : uint8_t
+	{
+		Start, // instants
+		Stop,
+		Complete,
+		Run, // spans
+		Receive,
+		Consume,
+		FlowOut, // message hops
+		FlowIn
+	};
+
+	struct Event
+	{
+		EventType Type = EventType::Start;
+		int64_t Begin = 0; // steady_clock, nanoseconds
+		int64_t Duration = 0; // nanoseconds (spans only)
+		const void* Agent = nullptr;
+		uint64_t Argument = 0; // messages (Consume) or flow id (FlowOut and FlowIn)
+		uint32_t Thread = 0; // the order in which threads have traced their first event
+	};
+
+	inline constexpr size_t DefaultEventsPerThread = 16384;
+
+	namespace Details
+	{
+		inline std::atomic<bool> EnabledFlag = false;
+
+		inline int64_t Now() noexcept
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		// the events of one thread: only that thread writes, readers discard what might have been overwritten while they were reading
+		class Ring
+		{
+		public:
+			Ring(size_t capacity, uint32_t thread)
+				: m_slots(std::make_unique<Slot[]>(capacity)), m_mask(capacity - 1), m_thread(thread)
+			{
+
+			}
+
+			void Write(EventType type, int64_t begin, int64_t duration, const void* agent, uint64_t argument) noexcept
+			{
+				const auto index = m_written.load(std::memory_order_relaxed);
+				// pairs with the fence in ReadInto: a reader seeing any of these stores also sees m_written >= index
+				std::atomic_thread_fence(std::memory_order_release);
+				auto& words = m_slots[index & m_mask].Words;
+				words[0].store(static_cast<uint64_t>(type), std::memory_order_relaxed);
+				words[1].store(static_cast<uint64_t>(begin), std::memory_order_relaxed);
+				words[2].store(static_cast<uint64_t>(duration), std::memory_order_relaxed);
+				words[3].store(reinterpret_cast<uintptr_t>(agent), std::memory_order_relaxed);
+				words[4].store(argument, std::memory_order_relaxed);
+				m_written.store(index + 1, std::memory_order_release);
+			}
+
+			void ReadInto(std::vector<Event>& events) const
+			{
+				const auto capacity = m_mask + 1;
+				const auto written = m_written.load(std::memory_order_acquire);
+				const auto cleared = m_cleared.load(std::memory_order_relaxed);
+				auto from = (std::max)(cleared, written > capacity ? written - capacity : 0);
+				std::vector<Event> read;
+				read.reserve(static_cast<size_t>(written - from));
+				for (auto index = from; index < written; ++index)
+				{
+					const auto& words = m_slots[index & m_mask].Words;
+					Event event;
+					event.Type = static_cast<EventType>(words[0].load(std::memory_order_relaxed));
+					event.Begin = static_cast<int64_t>(words[1].load(std::memory_order_relaxed));
+					event.Duration = static_cast<int64_t>(words[2].load(std::memory_order_relaxed));
+					event.Agent = reinterpret_cast<const void*>(static_cast<uintptr_t>(words[3].load(std::memory_order_relaxed)));
+					event.Argument = words[4].load(std::memory_order_relaxed);
+					event.Thread = m_thread;
+					read.push_back(event);
+				}
+				std::atomic_thread_fence(std::memory_order_acquire);
+				// the writer might be overwriting the slot of index "now - capacity": that one and the previous ones are not reliable
+				const auto now = m_written.load(std::memory_order_relaxed);
+				const auto firstValid = now >= capacity ? now - capacity + 1 : 0;
+				const auto skip = firstValid > from ? (std::min)(static_cast<size_t>(firstValid - from), read.size()) : size_t{ 0 };
+				events.insert(events.end(), read.begin() + static_cast<std::ptrdiff_t>(skip), read.end());
+			}
+
+			void Clear() noexcept
+			{
+				m_cleared.store(m_written.load(std::memory_order_acquire), std::memory_order_relaxed);
+			}
+		private:
+			struct Slot
+			{
+				std::atomic<uint64_t> Words[5];
+			};
+
+			std::unique_ptr<Slot[]> m_slots;
+			uint64_t m_mask;
+			uint32_t m_thread;
+			alignas(64) std::atomic<uint64_t> m_written = 0;
+			std::atomic<uint64_t> m_cleared = 0;
+		};
+
+		// all the rings (kept also after their thread has exited) and the names of the agents
+		class Registry
+		{
+		public:
+			static Registry& Instance()
+			{
+				static Registry registry;
+				return registry;
+			}
+
+			// nullptr if it can't be allocated (the event is lost)
+			Ring* RingOfThisThread() noexcept
+			{
+				thread_local std::shared_ptr<Ring> ring;
+				if (!ring)
+				{
+					try
+					{
+						std::lock_guard lock{ m_mutex };
+						ring = std::make_shared<Ring>(m_eventsPerThread, static_cast<uint32_t>(m_rings.size()));
+						m_rings.push_back(ring);
+					}
+					catch (...)
+					{
+						return nullptr;
+					}
+				}
+				return ring.get();
+			}
+
+			void SetEventsPerThread(size_t events)
+			{
+				size_t capacity = 1;
+				while (capacity < events)
+				{
+					capacity *= 2;
+				}
+				std::lock_guard lock{ m_mutex };
+				m_eventsPerThread = capacity;
+			}
+
+			void SetName(const void* agent, std::string name)
+			{
+				std::lock_guard lock{ m_mutex };
+				m_names[agent] = std::move(name);
+			}
+
+			std::unordered_map<const void*, std::string> Names()
+			{
+				std::lock_guard lock{ m_mutex };
+				return m_names;
+			}
+
+			std::vector<Event> Collect()
+			{
+				std::vector<Event> events;
+				std::lock_guard lock{ m_mutex };
+				for (const auto& ring : m_rings)
+				{
+					ring->ReadInto(events);
+				}
+				return events;
+			}
+
+			[[nodiscard]] size_t Threads()
+			{
+				std::lock_guard lock{ m_mutex };
+				return m_rings.size();
+			}
+
+			void Clear()
+			{
+				std::lock_guard lock{ m_mutex };
+				for (const auto& ring : m_rings)
+				{
+					ring->Clear();
+				}
+			}
+		private:
+			std::mutex m_mutex;
+			std::vector<std::shared_ptr<Ring>> m_rings;
+			std::unordered_map<const void*, std::string> m_names;
+			size_t m_eventsPerThread = DefaultEventsPerThread;
+		};
+
+		inline const char* NameOf(EventType type) noexcept
+		{
+			switch (type)
+			{
+			case EventType::Start: return "Start";
+			case EventType::Stop: return "Stop";
+			case EventType::Complete: return "Complete";
+			case EventType::Run: return "Run";
+			case EventType::Receive: return "Receive";
+			case EventType::Consume: return "Consume";
+			case EventType::FlowOut: return "Send";
+			case EventType::FlowIn: return "Receive";
+			}
+			return "?";
+		}
+
+#if defined(PPLAGENTS_TRACING) && defined(_WIN32)
+		// manifest-free ETW provider, registered by Enable
+		class EtwProvider
+		{
+		public:
+			static EtwProvider& Instance()
+			{
+				static EtwProvider provider;
+				return provider;
+			}
+
+			void Write(EventType type, int64_t duration, const void* agent, uint64_t argument) noexcept
+			{
+				if (!m_listening.load(std::memory_order_relaxed))
+				{
+					return;
+				}
+				wchar_t text[128];
+				swprintf(text, 128, L"%hs agent=%p duration=%lldns argument=%llu", NameOf(type), agent, static_cast<long long>(duration), static_cast<unsigned long long>(argument));
+				EventWriteString(m_handle, 4, 0, text);
+			}
+		private:
+			EtwProvider()
+			{
+				static const GUID id = { 0xb8a0c2e4, 0x5d1f, 0x4e7a, { 0x9c, 0x3b, 0x2f, 0x6d, 0x8e, 0x1a, 0x4c, 0x70 } };
+				EventRegister(&id, &EtwProvider::OnEnable, this, &m_handle);
+			}
+
+			~EtwProvider()
+			{
+				EventUnregister(m_handle);
+			}
+
+			static void NTAPI OnEnable(LPCGUID, ULONG isEnabled, UCHAR, ULONGLONG, ULONGLONG, PEVENT_FILTER_DESCRIPTOR, PVOID context)
+			{
+				static_cast<EtwProvider*>(context)->m_listening.store(isEnabled != 0, std::memory_order_relaxed);
+			}
+
+			REGHANDLE m_handle = 0;
+			std::atomic<bool> m_listening = false;
+		};
+#endif
+
+		inline void Record(EventType type, int64_t begin, int64_t duration, const void* agent, uint64_t argument) noexcept
+		{
+			if (auto* ring = Registry::Instance().RingOfThisThread())
+			{
+				ring->Write(type, begin, duration, agent, argument);
+			}
+#if defined(PPLAGENTS_TRACING) && defined(_WIN32)
+			EtwProvider::Instance().Write(type, duration, agent, argument);
+#endif
+		}
+
+		inline void WriteEscaped(std::ostream& out, const std::string& text)
+		{
+			for (const auto c : text)
+			{
+				switch (c)
+				{
+				case '"': out << "\\\""; break;
+				case '\\': out << "\\\\"; break;
+				case '\n': out << "\\n"; break;
+				default:
+					if (static_cast<unsigned char>(c) >= 0x20)
+					{
+						out << c;
+					}
+				}
+			}
+		}
+	}
+
+	// true if tracing is compiled in and enabled: what a disabled trace point costs
+	inline bool Enabled() noexcept
+	{
+#if defined(PPLAGENTS_TRACING)
+		return Details::EnabledFlag.load(std::memory_order_relaxed);
+#else
+		return false;
+#endif
+	}
+
+	// starts tracing, into rings of (at least) "eventsPerThread" events for the threads tracing from now on.
+	// False if tracing is not compiled in (PPLAGENTS_TRACING)
+	inline bool Enable(size_t eventsPerThread = DefaultEventsPerThread)
+	{
+#if defined(PPLAGENTS_TRACING)
+		Details::Registry::Instance().SetEventsPerThread(eventsPerThread);
+#if defined(_WIN32)
+		Details::EtwProvider::Instance();
+#endif
+		Details::EnabledFlag.store(true, std::memory_order_relaxed);
+		return true;
+#else
+		(void)eventsPerThread;
+		return false;
+#endif
+	}
+
+	// stops tracing: the events traced so far are kept
+	inline void Disable() noexcept
+	{
+		Details::EnabledFlag.store(false, std::memory_order_relaxed);
+	}
+
+	// forgets the events traced so far
+	inline void Clear()
+	{
+		Details::Registry::Instance().Clear();
+	}
+
+	// the name of "agent" in the exported trace (instead of its address).
+	// Events are traced by the Agent base of the agent: &agent converts to it (whatever the agent derives from first)
+	inline void SetName(const Agents::Agent* agent, std::string name)
+	{
+		Details::Registry::Instance().SetName(agent, std::move(name));
+	}
+
+	// the events still in the rings, by time
+	inline std::vector<Event> Collect()
+	{
+		auto events = Details::Registry::Instance().Collect();
+		std::stable_sort(events.begin(), events.end(), [](const Event& left, const Event& right) { return left.Begin < right.Begin; });
+		return events;
+	}
+
+	// trace points (used by Agent and AsyncConsumerAgent)
+	inline void Instant(EventType type, const void* agent) noexcept
+	{
+		if (Enabled())
+		{
+			Details::Record(type, Details::Now(), 0, agent, 0);
+		}
+	}
+
+	inline void Span(EventType type, const void* agent, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::duration duration, uint64_t messages = 0) noexcept
+	{
+		if (Enabled())
+		{
+			const auto start = std::chrono::duration_cast<std::chrono::nanoseconds>(begin.time_since_epoch()).count();
+			Details::Record(type, start, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), agent, messages);
+		}
+	}
+
+	// a message with this "id" leaves the current span (e.g. it's sent by Consume to the next stage)
+	inline void FlowOut(uint64_t id) noexcept
+	{
+		if (Enabled())
+		{
+			Details::Record(EventType::FlowOut, Details::Now(), 0, nullptr, id);
+		}
+	}
+
+	// a message with this "id" arrives: the flow ends in the next span of this thread (e.g. Consume)
+	inline void FlowIn(uint64_t id) noexcept
+	{
+		if (Enabled())
+		{
+			Details::Record(EventType::FlowIn, Details::Now(), 0, nullptr, id);
+		}
+	}
+
+	// writes the events in the Chrome trace event format (JSON), timestamps relative to the first event
+	inline void ExportChromeTrace(std::ostream& out)
+	{
+		const auto events = Collect();
+		const auto names = Details::Registry::Instance().Names();
+		const auto origin = events.empty() ? int64_t{ 0 } : events.front().Begin;
+		const auto threads = Details::Registry::Instance().Threads();
+		const auto micros = [&](int64_t nanoseconds) {
+			std::ostringstream text;
+			text.setf(std::ios::fixed);
+			text.precision(3);
+			text << static_cast<double>(nanoseconds) / 1000.0;
+			return text.str();
+		};
+
+		out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+		auto first = true;
+		const auto separate = [&] {
+			out << (first ? "\n" : ",\n");
+			first = false;
+		};
+		for (size_t thread = 0; thread < threads; ++thread)
+		{
+			separate();
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread << ",\"args\":{\"name\":\"thread " << thread << "\"}}";
+		}
+		for (const auto& event : events)
+		{
+			separate();
+			out << "{\"name\":\"" << Details::NameOf(event.Type) << "\",\"pid\":1,\"tid\":" << event.Thread << ",\"ts\":" << micros(event.Begin - origin);
+			switch (event.Type)
+			{
+			case EventType::FlowOut:
+				out << ",\"cat\":\"flow\",\"ph\":\"s\",\"id\":" << event.Argument << "}";
+				continue;
+			case EventType::FlowIn:
+				out << ",\"cat\":\"flow\",\"ph\":\"f\",\"id\":" << event.Argument << "}";
+				continue;
+			case EventType::Run:
+			case EventType::Receive:
+			case EventType::Consume:
+				out << ",\"cat\":\"agent\",\"ph\":\"X\",\"dur\":" << micros(event.Duration);
+				break;
+			default:
+				out << ",\"cat\":\"agent\",\"ph\":\"i\",\"s\":\"t\"";
+				break;
+			}
+			out << ",\"args\":{\"agent\":\"";
+			if (const auto name = names.find(event.Agent); name != names.end())
+			{
+				Details::WriteEscaped(out, name->second);
+			}
+			else
+			{
+				out << event.Agent;
+			}
+			out << "\"";
+			if (event.Type == EventType::Consume)
+			{
+				out << ",\"messages\":" << event.Argument;
+			}
+			out << "}}";
+		}
+		out << "\n]}\n";
+	}
+
+	// false if "path" can't be written
+	inline bool ExportChromeTrace(const std::string& path)
+	{
+		std::ofstream out{ path };
+		if (!out)
+		{
+			return false;
+		}
+		ExportChromeTrace(out);
+		return static_cast<bool>(out);
+	}
+}
+
+namespace Agents::Skills
+{
+	// ends, in the Consume span, the flow of each message received by an AsyncConsumerAgent (see Tracing::FlowIn):
+	// FlowIdOf()(message) is the id given to Tracing::FlowOut by who sent it
+	//
+	// struct ByOrderId { uint64_t operator()(const Order& order) const { return order.Id; } };
+	// AgentComposer<AsyncConsumerAgent<Shipping>, TracedFlow<Order, ByOrderId>::Skill, AutoStart, AutoStopAndWait> shipping{ buffer };
+	//
+	template<typename T, typename FlowIdOf>
+	struct TracedFlow
+	{
+		template<typename Agent>
+		struct Skill
+		{
+			// consume loop hook (see AgentComposer)
+			void OnMessage(const T& message)
+			{
+				Tracing::FlowIn(FlowIdOf{}(message));
+			}
+		};
+	};
+}
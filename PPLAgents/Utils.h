@@ -1,4 +1,8 @@
 #pragma once
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include "Backend.h"
 
 namespace Agents::Utils
 {
@@ -22,5 +26,94 @@ namespace Agents::Utils
 	};
 
 	template<typename T>
-	T detect(Concurrency::ISource<T>&);	
+	T detect(Concurrency::ISource<T>&);
+
+	// base of the buffers of T that are not message blocks but can still be a Consumer m_buffer (e.g. SpscBuffer):
+	// they come with their own receiver (see MakeReceiver) and try_receive
+	template<typename T>
+	struct DirectSource
+	{
+	};
+
+	template<typename T>
+	T detect(DirectSource<T>&);
+
+	// minimal non-owning view over contiguous elements (std::span is not available in C++17)
+	template<typename T>
+	class span
+	{
+	public:
+		span(T* data, size_t size) noexcept
+			: m_data(data), m_size(size) {}
+
+		// span<T> -> span<const T>
+		template<typename U, typename = std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>>>
+		span(const span<U>& other) noexcept
+			: m_data(other.data()), m_size(other.size()) {}
+
+		[[nodiscard]] T* data() const noexcept { return m_data; }
+		[[nodiscard]] size_t size() const noexcept { return m_size; }
+		[[nodiscard]] bool empty() const noexcept { return m_size == 0; }
+		[[nodiscard]] T* begin() const noexcept { return m_data; }
+		[[nodiscard]] T* end() const noexcept { return m_data + m_size; }
+		[[nodiscard]] T& operator[](size_t idx) const noexcept { return m_data[idx]; }
+	private:
+		T* m_data;
+		size_t m_size;
+	};
+
+	// Payload wrapper to let move-only (or expensive to copy) values travel through message blocks.
+	// Message blocks copy payloads from "const T&" when a message is sent and when it's received:
+	// "copying" a Movable transfers the value instead (like the old std::auto_ptr).
+	// For this reason, use it only with blocks that deliver each message exactly once (e.g. unbounded_buffer)
+	// and never with blocks that duplicate messages (e.g. overwrite_buffer, single_assignment)
+	//
+	// Concurrency::unbounded_buffer<Movable<std::unique_ptr<Big>>> buffer;
+	// send(buffer, Movable{ std::make_unique<Big>() });
+	template<typename T>
+	class Movable
+	{
+	public:
+		Movable() = default;
+
+		Movable(T value)
+			: m_value(std::move(value))
+		{
+
+		}
+
+		Movable(const Movable& other)
+			: m_value(std::move(other.m_value))
+		{
+
+		}
+
+		Movable& operator=(const Movable& other)
+		{
+			m_value = std::move(other.m_value);
+			return *this;
+		}
+
+		Movable(Movable&&) = default;
+		Movable& operator=(Movable&&) = default;
+
+		[[nodiscard]] T& Get() & noexcept { return m_value; }
+		[[nodiscard]] const T& Get() const & noexcept { return m_value; }
+		[[nodiscard]] T&& Get() && noexcept { return std::move(m_value); }
+	private:
+		mutable T m_value;
+	};
+
+	// gives the value wrapped in a Movable (or the value itself)
+	template<typename T>
+	T&& Unwrap(T&& value) noexcept
+	{
+		return std::forward<T>(value);
+	}
+
+	template<typename T>
+	T&& Unwrap(Movable<T>&& value) noexcept
+	{
+		return std::move(value).Get();
+	}
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <thread>
 #include "Agent.h"
 #include "AsyncConsumer.h"
+#include "Pipeline.h"
 #include "StrategyBasedAsyncConsumer.h"
 
 using namespace std::chrono_literals;
@@ -82,4 +83,41 @@ int main()
 			send(strings, std::to_string(i));
 		}
 	}
-}
\ No newline at end of file
+
+	{
+		// example of using StrategyBasedAsyncConsumer with a compile-time strategy (no virtual calls)
+
+		auto action = [](const std::string& s) {
+			std::cout << "Getting a message from inlined lambda: " << s << "\n";
+		};
+
+		Concurrency::unbounded_buffer<std::string> strings;
+		StrategyBasedAsyncConsumer<std::string, decltype(action)> anotherConsumer{ strings, action };
+
+		for (auto i = 0; i < 5; ++i)
+		{
+			send(strings, std::to_string(i));
+		}
+	}
+
+	{
+		// example of a Pipeline: stages are stopped from the head, so everything sent reaches the tail
+
+		Pipeline<int> pipeline{ 16 };
+		pipeline.From()
+			.Filter([](int i) { return i % 2 == 0; })
+			.Stage<2>(8)
+			.Transform([](int i) { return std::to_string(i * i); })
+			.Batch<4>()
+			.ForEach([](const std::vector<std::string>& batch) {
+				std::cout << "Pipeline batch of " << batch.size() << " squares, first: " << batch.front() << "\n";
+			});
+		pipeline.Start();
+
+		for (auto i = 0; i < 20; ++i)
+		{
+			Send(pipeline.Input(), i);
+		}
+		pipeline.StopAndWait();
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Benchmarks
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct Result
+	{
+		std::string Name;
+		double Value;
+		std::string Unit;
+	};
+
+	// everything reported so far (in order), to be written in a machine-readable format at the end
+	inline std::vector<Result>& Results()
+	{
+		static std::vector<Result> results;
+		return results;
+	}
+
+	inline void Report(const std::string& name, double value, const std::string& unit)
+	{
+		std::cout << std::left << std::setw(56) << name << std::right << std::setw(10) << std::fixed << std::setprecision(1) << value << " " << unit << "\n";
+		Results().push_back({ name, value, unit });
+	}
+
+	// runs "body" "repetitions" times and reports the best time per operation.
+	// "body" performs "operations" operations and returns the time they took (so it can exclude its own setup)
+	template<typename Body>
+	void Run(const std::string& name, size_t operations, Body body, int repetitions = 5)
+	{
+		auto best = std::numeric_limits<double>::max();
+		for (auto i = 0; i < repetitions; ++i)
+		{
+			const std::chrono::duration<double, std::nano> elapsed = body();
+			best = (std::min)(best, elapsed.count() / operations);
+		}
+		Report(name, best, "ns/op");
+	}
+
+	// operator new calls so far (counted by the replacement operator new in main.cpp)
+	inline std::atomic<size_t>& Allocations()
+	{
+		static std::atomic<size_t> allocations = 0;
+		return allocations;
+	}
+
+	// like Run, but also reports the heap allocations per operation of the last repetition (the previous ones warm up pools)
+	template<typename Body>
+	void RunCountingAllocations(const std::string& name, size_t operations, Body body, int repetitions = 5)
+	{
+		auto best = std::numeric_limits<double>::max();
+		size_t allocations = 0;
+		for (auto i = 0; i < repetitions; ++i)
+		{
+			const auto before = Allocations().load(std::memory_order_relaxed);
+			const std::chrono::duration<double, std::nano> elapsed = body();
+			allocations = Allocations().load(std::memory_order_relaxed) - before;
+			best = (std::min)(best, elapsed.count() / operations);
+		}
+		Report(name, best, "ns/op");
+		Report(name + " allocations", static_cast<double>(allocations) / operations, "allocs/op");
+	}
+
+	// value below which "percentile" (e.g. 0.99) of "samples" are (reorders "samples")
+	inline double Percentile(std::vector<double>& samples, double percentile)
+	{
+		if (samples.empty())
+		{
+			return 0;
+		}
+		const auto nth = samples.begin() + static_cast<std::ptrdiff_t>(percentile * (samples.size() - 1));
+		std::nth_element(samples.begin(), nth, samples.end());
+		return *nth;
+	}
+
+	// reports p50 and p99 of "samples" (in nanoseconds)
+	inline void ReportLatency(const std::string& name, std::vector<double>& samples)
+	{
+		Report(name + " p50", Percentile(samples, 0.50), "ns");
+		Report(name + " p99", Percentile(samples, 0.99), "ns");
+	}
+
+	// {"benchmarks":[{"name":"...","value":...,"unit":"..."},...]}, one result per line so results can be diffed
+	inline void WriteJson(std::ostream& os)
+	{
+		const auto quoted = [](const std::string& s) {
+			std::string out = "\"";
+			for (auto c : s)
+			{
+				if (c == '"' || c == '\\')
+				{
+					out += '\\';
+				}
+				out += c;
+			}
+			return out + "\"";
+		};
+
+		os << "{\n  \"benchmarks\": [\n";
+		const auto& results = Results();
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			os << "    { \"name\": " << quoted(results[i].Name) << ", \"value\": " << std::setprecision(3) << std::fixed << results[i].Value
+				<< ", \"unit\": " << quoted(results[i].Unit) << " }" << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		os << "  ]\n}\n";
+	}
+}
@@ -0,0 +1,485 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "AsyncConsumer.h"
+#include "BoundedBuffer.h"
+#include "ParallelAsyncConsumer.h"
+#include "PartitionedAsyncConsumer.h"
+#include "RateLimiting.h"
+#include "Recording.h"
+#include "SpscBuffer.h"
+#include "Tracing.h"
+#include "Benchmark.h"
+
+namespace Benchmarks
+{
+	// AsyncConsumerAgent end to end: throughput, latency, Stop-to-Wait time and scaling with the number of consumers (and of shards)
+	namespace Consumers
+	{
+		using Small = int;
+		using Large = std::array<char, 4096>;
+
+		template<typename Payload>
+		struct Timed
+		{
+			Clock::time_point Sent;
+			Payload Data;
+		};
+
+		template<typename Payload>
+		class CountingConsumer
+		{
+		public:
+			explicit CountingConsumer(Concurrency::ISource<Payload>& buffer)
+				: m_buffer(buffer)
+			{
+
+			}
+		protected:
+			void Consume(const Payload&)
+			{
+				++m_consumed;
+			}
+
+			Concurrency::ISource<Payload>& m_buffer;
+		private:
+			size_t m_consumed = 0;
+		};
+
+		// CountingConsumer on its own SpscBuffer (one producer)
+		template<typename Payload>
+		class SpscCountingConsumer
+		{
+		protected:
+			void Consume(const Payload&)
+			{
+				++m_consumed;
+			}
+
+			Agents::SpscBuffer<Payload> m_buffer;
+		private:
+			size_t m_consumed = 0;
+		};
+
+		// records the time each message took from send to Consume, then acknowledges it
+		template<typename Payload>
+		class LatencyConsumer
+		{
+		public:
+			LatencyConsumer(Concurrency::ISource<Timed<Payload>>& buffer, std::vector<double>& latencies, Concurrency::ITarget<bool>& consumed)
+				: m_buffer(buffer), m_latencies(latencies), m_consumed(consumed)
+			{
+
+			}
+		protected:
+			void Consume(const Timed<Payload>& message)
+			{
+				m_latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - message.Sent).count());
+				asend(m_consumed, true);
+			}
+
+			Concurrency::ISource<Timed<Payload>>& m_buffer;
+		private:
+			std::vector<double>& m_latencies;
+			Concurrency::ITarget<bool>& m_consumed;
+		};
+
+		// some CPU-bound work per message, so that adding consumers can pay off
+		class WorkingConsumer
+		{
+		public:
+			explicit WorkingConsumer(Concurrency::ISource<Small>& buffer)
+				: m_buffer(buffer)
+			{
+
+			}
+		protected:
+			void Consume(Small value)
+			{
+				auto hash = static_cast<unsigned>(value);
+				for (auto i = 0; i < 256; ++i)
+				{
+					hash = hash * 31u + 7u;
+				}
+				m_sink = hash;
+			}
+
+			Concurrency::ISource<Small>& m_buffer;
+		private:
+			volatile unsigned m_sink = 0;
+		};
+
+		// WorkingConsumer on a BoundedBuffer, that the drain of last values seals
+		class SealedWorkingConsumer : public WorkingConsumer
+		{
+		public:
+			explicit SealedWorkingConsumer(Agents::BoundedBuffer<Small>& buffer)
+				: WorkingConsumer(buffer), m_buffer(buffer)
+			{
+
+			}
+		protected:
+			Agents::BoundedBuffer<Small>& m_buffer;
+		};
+
+		// WorkingConsumer for PartitionedAsyncConsumerAgent (that owns the buffers)
+		class PartitionedWorkingConsumer
+		{
+		protected:
+			void Consume(Small value)
+			{
+				auto hash = static_cast<unsigned>(value);
+				for (auto i = 0; i < 256; ++i)
+				{
+					hash = hash * 31u + 7u;
+				}
+				m_sink = hash;
+			}
+		private:
+			volatile unsigned m_sink = 0;
+		};
+
+		// state updates for 16 keys (e.g. instruments), only the newest value of each one matters
+		struct ByKey
+		{
+			Small operator()(Small update) const
+			{
+				return update % 16;
+			}
+		};
+
+		// a skill hooked into the consume loop (see AgentComposer)
+		template<typename T>
+		struct CountConsumed
+		{
+			void OnAfterConsume(size_t messages)
+			{
+				m_consumed += messages;
+			}
+
+			size_t m_consumed = 0;
+		};
+
+		template<typename Consumer, typename ReceivePolicy = Agents::Skills::BlockingReceive>
+		using RAIIConsumer = Agents::AsyncConsumer<Consumer, Agents::Skills::AutoStart, Agents::Skills::AutoStop, Agents::Skills::AutoWait, Agents::Skills::RetainLastValues, ReceivePolicy>;
+
+		// time to send "messages" messages and have all of them consumed by "Agent"
+		template<typename Payload, typename Agent>
+		Clock::duration TimeThroughput(size_t messages)
+		{
+			Concurrency::unbounded_buffer<Payload> buffer;
+			const Payload prototype{};
+			const auto start = Clock::now();
+			{
+				Agent agent{ buffer };
+				for (size_t i = 0; i < messages; ++i)
+				{
+					send(buffer, prototype);
+				}
+			} // stopped and waited: the remaining messages are consumed as last values
+			return Clock::now() - start;
+		}
+
+		// like TimeThroughput, for an Agent owning its buffer
+		template<typename Payload, typename Agent>
+		Clock::duration TimeOwnBufferThroughput(size_t messages)
+		{
+			const Payload prototype{};
+			const auto start = Clock::now();
+			{
+				Agent agent;
+				for (size_t i = 0; i < messages; ++i)
+				{
+					Send(agent.Buffer(), prototype);
+				}
+			}
+			return Clock::now() - start;
+		}
+
+		inline std::string BenchmarkLog()
+		{
+			return (std::filesystem::temp_directory_path() / "PPLAgentsBenchmarks.log").string();
+		}
+
+		// like TimeThroughput, with every message recorded into BenchmarkLog() (see Skills::Recorded)
+		inline Clock::duration TimeRecorded(size_t messages)
+		{
+			using Agent = Agents::AgentComposer<Agents::AsyncConsumerAgent<CountingConsumer<Small>>, Agents::Skills::Recorded<Small>::Skill, Agents::Skills::AutoStart, Agents::Skills::AutoStopAndWait>;
+			Concurrency::unbounded_buffer<Small> buffer;
+			const auto start = Clock::now();
+			{
+				Agents::MessageRecorder<Small> recorder{ BenchmarkLog() };
+				Agent agent{ buffer };
+				agent.RecordTo(&recorder);
+				for (size_t i = 0; i < messages; ++i)
+				{
+					send(buffer, static_cast<Small>(i));
+				}
+			} // everything recorded is in the log here
+			return Clock::now() - start;
+		}
+
+		// time to replay (as fast as possible) a log of "messages" messages and have all of them consumed
+		inline Clock::duration TimeReplay(size_t messages)
+		{
+			TimeRecorded(messages);
+			Concurrency::unbounded_buffer<Small> buffer;
+			const auto start = Clock::now();
+			{
+				RAIIConsumer<CountingConsumer<Small>> agent{ buffer };
+				Agents::LogReplay<Small> replay{ BenchmarkLog(), buffer };
+				replay.Start();
+				replay.Wait();
+			}
+			const auto elapsed = Clock::now() - start;
+			std::filesystem::remove(BenchmarkLog());
+			return elapsed;
+		}
+
+		// like TimeThroughput, with tracing enabled
+		template<typename Payload, typename Agent>
+		Clock::duration TimeTracedThroughput(size_t messages)
+		{
+			Agents::Tracing::Enable();
+			const auto elapsed = TimeThroughput<Payload, Agent>(messages);
+			Agents::Tracing::Disable();
+			Agents::Tracing::Clear();
+			return elapsed;
+		}
+
+		// like TimeThroughput, but each message is a different update (see ByKey)
+		template<typename Agent>
+		Clock::duration TimeUpdates(size_t messages)
+		{
+			Concurrency::unbounded_buffer<Small> buffer;
+			const auto start = Clock::now();
+			{
+				Agent agent{ buffer };
+				for (size_t i = 0; i < messages; ++i)
+				{
+					send(buffer, static_cast<Small>(i));
+				}
+			}
+			return Clock::now() - start;
+		}
+
+		// one message at a time (the next one is sent after the previous has been consumed), so there is no queueing
+		template<typename Payload, typename ReceivePolicy = Agents::Skills::BlockingReceive>
+		void MeasureLatency(const std::string& name, size_t samples)
+		{
+			Concurrency::unbounded_buffer<Timed<Payload>> buffer;
+			Concurrency::unbounded_buffer<bool> consumed;
+			std::vector<double> latencies;
+			latencies.reserve(samples);
+			{
+				RAIIConsumer<LatencyConsumer<Payload>, ReceivePolicy> agent{ buffer, latencies, consumed };
+				for (size_t i = 0; i < samples; ++i)
+				{
+					send(buffer, Timed<Payload>{ Clock::now(), Payload{} });
+					receive(consumed);
+				}
+			}
+			ReportLatency(name, latencies);
+		}
+
+		// time from Stop() (while the agent is blocked receiving from an empty buffer) until Wait() returns
+		inline void MeasureStopToWait(size_t samples)
+		{
+			using Agent = Agents::AsyncConsumer<LatencyConsumer<Small>, Agents::Skills::ManualStart, Agents::Skills::ManualStop, Agents::Skills::ManualWait, Agents::Skills::RetainLastValues>;
+			std::vector<double> latencies;
+			std::vector<double> ignored;
+			latencies.reserve(samples);
+			for (size_t i = 0; i < samples; ++i)
+			{
+				Concurrency::unbounded_buffer<Timed<Small>> buffer;
+				Concurrency::unbounded_buffer<bool> consumed;
+				Agent agent{ buffer, ignored, consumed };
+				agent.Start();
+				// once the first message is consumed, the agent is running (and it goes back to receive)
+				send(buffer, Timed<Small>{ Clock::now(), 0 });
+				receive(consumed);
+
+				const auto start = Clock::now();
+				agent.Stop();
+				agent.Wait();
+				latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+			}
+			ReportLatency("consumer/Stop to Wait", latencies);
+		}
+
+		// time from Stop() until Wait() returns with "backlog" messages still in the buffer, processed according to LastValuesPolicy
+		template<typename LastValuesPolicy>
+		void MeasureShutdown(const std::string& name, size_t backlog)
+		{
+			using Agent = Agents::AsyncConsumer<WorkingConsumer, Agents::Skills::ManualStart, Agents::Skills::ManualStop, Agents::Skills::ManualWait, LastValuesPolicy>;
+			Concurrency::unbounded_buffer<Small> buffer;
+			Agent agent{ buffer };
+			for (size_t i = 0; i < backlog; ++i)
+			{
+				send(buffer, static_cast<Small>(i));
+			}
+			agent.Start();
+			const auto start = Clock::now();
+			agent.StopAndWait();
+			Report(name, std::chrono::duration<double, std::milli>(Clock::now() - start).count(), "ms");
+		}
+
+		// like MeasureShutdown with RetainLastValues, while a producer keeps sending: the drain takes only the backlog at the time it starts
+		// and the producer stops when its messages are rejected
+		inline void MeasureShutdownUnderLoad(const std::string& name, size_t backlog)
+		{
+			using Agent = Agents::AsyncConsumer<SealedWorkingConsumer, Agents::Skills::ManualStart, Agents::Skills::ManualStop, Agents::Skills::ManualWait, Agents::Skills::RetainLastValues>;
+			Agents::BoundedBuffer<Small> buffer;
+			Agent agent{ buffer };
+			for (size_t i = 0; i < backlog; ++i)
+			{
+				Send(buffer, static_cast<Small>(i));
+			}
+			std::thread producer{ [&] {
+				for (Small i = 0; Send(buffer, i); ++i)
+				{
+				}
+			} };
+			agent.Start();
+			const auto start = Clock::now();
+			agent.StopAndWait();
+			Report(name, std::chrono::duration<double, std::milli>(Clock::now() - start).count(), "ms");
+			producer.join();
+		}
+
+		// RateLimited<Rate, Burst> actually throttling a large backlog for "window": the rate reached and the time spent waiting for tokens,
+		// then the time from Stop() (while the loop waits for a token) until Wait() returns
+		template<size_t Rate, size_t Burst>
+		void MeasureRateLimited(const std::string& name, std::chrono::milliseconds window)
+		{
+			using Agent = Agents::AgentComposer<Agents::AsyncConsumerAgent<CountingConsumer<Small>, Agents::Skills::DropLastValues>, Agents::Skills::RateLimited<Rate, Burst>::template Skill, CountConsumed>;
+			Concurrency::unbounded_buffer<Small> buffer;
+			for (size_t i = 0; i < Rate * 10; ++i)
+			{
+				send(buffer, static_cast<Small>(i));
+			}
+			Agent agent{ buffer };
+			const auto start = Clock::now();
+			agent.Start();
+			std::this_thread::sleep_for(window);
+			const auto stopping = Clock::now();
+			agent.Stop();
+			agent.Wait();
+			const auto stopToWait = std::chrono::duration<double, std::milli>(Clock::now() - stopping).count();
+			const auto rate = static_cast<CountConsumed<Agent>&>(agent).m_consumed / std::chrono::duration<double>(stopping - start).count();
+			Report(name + " (rate)", rate, "messages/s");
+			Report(name + " (throttled)", std::chrono::duration<double, std::milli>(agent.ThrottledTime()).count(), "ms");
+			Report(name + " (Stop to Wait)", stopToWait, "ms");
+			// a full bucket at the beginning, then Rate per second (and some slack for the clock and the token due at the end)
+			const auto seconds = std::chrono::duration<double>(window).count();
+			if (rate > ((Burst + Rate * seconds) * 1.1 + 1) / seconds)
+			{
+				throw std::logic_error("RateLimited: the rate is not limited");
+			}
+			// waiting for a token is interrupted by the cancellation, instead of lasting up to 1 / Rate
+			if (stopToWait > 500.0 / Rate)
+			{
+				throw std::logic_error("RateLimited: Stop waits for the token");
+			}
+		}
+
+		template<size_t Consumers>
+		void MeasureScaling(size_t messages)
+		{
+			using Agent = Agents::ParallelAsyncConsumer<WorkingConsumer, Consumers, Agents::Skills::AutoStart, Agents::Skills::AutoStop, Agents::Skills::AutoWait, Agents::Skills::RetainLastValues>;
+			Run("consumer/scaling " + std::to_string(Consumers) + " consumer(s)", messages, [=] {
+				return TimeThroughput<Small, Agent>(messages);
+			});
+		}
+
+		template<size_t... Consumers>
+		void MeasureScaling(size_t messages, std::index_sequence<Consumers...>)
+		{
+			(MeasureScaling<Consumers>(messages), ...);
+		}
+
+		// like MeasureScaling, but each of the 16 keys (see ByKey) always goes to the same shard
+		template<size_t Shards>
+		void MeasurePartitionScaling(size_t messages)
+		{
+			using Agent = Agents::PartitionedAsyncConsumer<PartitionedWorkingConsumer, Small, Shards, ByKey, Agents::Skills::AutoStart, Agents::Skills::AutoStop, Agents::Skills::AutoWait, Agents::Skills::RetainLastValues>;
+			Run("consumer/scaling " + std::to_string(Shards) + " shard(s), per-key order", messages, [=] {
+				const auto start = Clock::now();
+				{
+					Agent agent;
+					for (size_t i = 0; i < messages; ++i)
+					{
+						agent.Send(static_cast<Small>(i));
+					}
+				}
+				return Clock::now() - start;
+			});
+		}
+
+		template<size_t... Shards>
+		void MeasurePartitionScaling(size_t messages, std::index_sequence<Shards...>)
+		{
+			(MeasurePartitionScaling<Shards>(messages), ...);
+		}
+
+		inline void RunAll(size_t messages)
+		{
+			RunCountingAllocations("consumer/throughput small payload", messages, [=] {
+				return TimeThroughput<Small, RAIIConsumer<CountingConsumer<Small>>>(messages);
+			});
+			RunCountingAllocations("consumer/throughput large payload (4 KiB)", messages / 10, [=] {
+				return TimeThroughput<Large, RAIIConsumer<CountingConsumer<Large>>>(messages / 10);
+			});
+			Run("consumer/throughput small payload, with a consume hook", messages, [=] {
+				return TimeThroughput<Small, Agents::AgentComposer<Agents::AsyncConsumerAgent<CountingConsumer<Small>>, CountConsumed, Agents::Skills::AutoStart, Agents::Skills::AutoStopAndWait>>(messages);
+			});
+			Run("consumer/throughput small payload, traced", messages, [=] {
+				return TimeTracedThroughput<Small, RAIIConsumer<CountingConsumer<Small>>>(messages);
+			});
+			Run("consumer/throughput small payload, RateLimited", messages, [=] {
+				return TimeThroughput<Small, Agents::AgentComposer<Agents::AsyncConsumerAgent<CountingConsumer<Small>>, Agents::Skills::RateLimited<1'000'000'000, 1'000'000>::Skill, Agents::Skills::AutoStart, Agents::Skills::AutoStopAndWait>>(messages);
+			});
+			Run("consumer/throughput small payload, recorded to a log", messages, [=] {
+				return TimeRecorded(messages);
+			});
+			Run("consumer/replay of a log, maximum speed", messages, [=] {
+				return TimeReplay(messages);
+			});
+			RunCountingAllocations("consumer/throughput small payload, SpscBuffer", messages, [=] {
+				return TimeOwnBufferThroughput<Small, RAIIConsumer<SpscCountingConsumer<Small>>>(messages);
+			});
+			RunCountingAllocations("consumer/throughput large payload (4 KiB), SpscBuffer", messages / 10, [=] {
+				return TimeOwnBufferThroughput<Large, RAIIConsumer<SpscCountingConsumer<Large>>>(messages / 10);
+			});
+
+			Run("consumer/state updates, every value", messages / 5, [=] {
+				return TimeUpdates<Agents::AsyncConsumer<WorkingConsumer, Agents::Skills::AutoStart, Agents::Skills::AutoStop, Agents::Skills::AutoWait, Agents::Skills::RetainLastValues>>(messages / 5);
+			});
+			Run("consumer/state updates, coalesced (16 keys)", messages / 5, [=] {
+				return TimeUpdates<Agents::AsyncConsumer<WorkingConsumer, Agents::Skills::AutoStart, Agents::Skills::AutoStop, Agents::Skills::AutoWait,
+					Agents::Skills::CoalesceLastValues<ByKey>, Agents::Skills::CoalescingReceive<Small, ByKey>>>(messages / 5);
+			});
+
+			MeasureLatency<Small>("consumer/latency small payload", messages / 100);
+			MeasureLatency<Large>("consumer/latency large payload (4 KiB)", messages / 100);
+			MeasureLatency<Small, Agents::Skills::AdaptiveSpinReceive<>>("consumer/latency small payload, spinning", messages / 100);
+
+			MeasureStopToWait(messages / 1000);
+			MeasureShutdown<Agents::Skills::RetainLastValues>("consumer/shutdown with backlog, RetainLastValues", messages);
+			MeasureShutdown<Agents::Skills::BoundedDrain<10>>("consumer/shutdown with backlog, BoundedDrain<10>", messages);
+			MeasureShutdownUnderLoad("consumer/shutdown with backlog, producer still sending", messages);
+
+			MeasureRateLimited<200, 10>("consumer/RateLimited<200, 10> for 1 s", std::chrono::seconds(1));
+			MeasureRateLimited<10, 1>("consumer/RateLimited<10, 1> for 1 s", std::chrono::seconds(1));
+
+			MeasureScaling(messages / 5, std::index_sequence<1, 2, 4, 8>{});
+			MeasurePartitionScaling(messages / 5, std::index_sequence<1, 2, 4, 8>{});
+		}
+	}
+}
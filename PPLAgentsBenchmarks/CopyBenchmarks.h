@@ -0,0 +1,92 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include "AsyncConsumer.h"
+#include "StrategyBasedAsyncConsumer.h"
+#include "Benchmark.h"
+
+namespace Benchmarks
+{
+	// how many times a (large) payload is copied and moved on its way from send to Consume
+	namespace Copies
+	{
+		struct Counters
+		{
+			static inline std::atomic<size_t> copies = 0;
+			static inline std::atomic<size_t> moves = 0;
+
+			static void Reset()
+			{
+				copies = 0;
+				moves = 0;
+			}
+		};
+
+		struct Payload
+		{
+			Payload() = default;
+			Payload(const Payload& other) : data(other.data) { ++Counters::copies; }
+			Payload(Payload&& other) noexcept : data(other.data) { ++Counters::moves; }
+			Payload& operator=(const Payload& other) { data = other.data; ++Counters::copies; return *this; }
+			Payload& operator=(Payload&& other) noexcept { data = other.data; ++Counters::moves; return *this; }
+
+			std::array<char, 4096> data{};
+		};
+
+		template<typename T, typename Sink>
+		struct ConsumerOf
+		{
+			ConsumerOf(Concurrency::unbounded_buffer<T>& buffer)
+				: m_buffer(buffer)
+			{
+
+			}
+		protected:
+			template<typename U>
+			void Consume(U&& value)
+			{
+				Sink::Consume(std::forward<U>(value));
+			}
+
+			Concurrency::unbounded_buffer<T>& m_buffer;
+		};
+
+		struct ByValue { static void Consume(Payload) {} };
+		struct ByConstRef { static void Consume(const Payload&) {} };
+		struct ByRValue { static void Consume(Payload&&) {} };
+
+		// sends "messages" payloads through "Agent" (constructed from the buffer) and reports copies and moves per message
+		template<typename T, typename Agent, typename... Args>
+		void Measure(const std::string& name, size_t messages, Args&&... args)
+		{
+			Concurrency::unbounded_buffer<T> buffer;
+			const T prototype{};
+			Counters::Reset();
+			{
+				Agent agent{ buffer, std::forward<Args>(args)... };
+				for (size_t i = 0; i < messages; ++i)
+				{
+					send(buffer, T{ prototype });
+				}
+			}
+			const auto copies = Counters::copies.load() / static_cast<double>(messages);
+			const auto moves = Counters::moves.load() / static_cast<double>(messages);
+			Report(name + " (copies)", copies, "per message");
+			Report(name + " (moves)", moves, "per message");
+		}
+
+		template<typename Consumer>
+		using RAIIConsumer = Agents::AsyncConsumer<Consumer, Agents::Skills::AutoStart, Agents::Skills::AutoStop, Agents::Skills::AutoWait, Agents::Skills::RetainLastValues>;
+
+		inline void RunAll(size_t messages)
+		{
+			// the copy made to create each message ("T{ prototype }") is counted too
+			Measure<Payload, RAIIConsumer<ConsumerOf<Payload, ByValue>>>("copies/Consume(T)", messages);
+			Measure<Payload, RAIIConsumer<ConsumerOf<Payload, ByConstRef>>>("copies/Consume(const T&)", messages);
+			Measure<Payload, RAIIConsumer<ConsumerOf<Payload, ByRValue>>>("copies/Consume(T&&)", messages);
+			Measure<Agents::Utils::Movable<Payload>, RAIIConsumer<ConsumerOf<Agents::Utils::Movable<Payload>, ByRValue>>>("copies/Movable<T> + Consume(T&&)", messages);
+			Measure<Payload, Agents::StrategyBasedAsyncConsumer<Payload>>("copies/StrategyBasedAsyncConsumer", messages,
+				std::make_unique<Agents::CallableConsumerStrategy<Payload>>([](const Payload&) {}));
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "AgentComposer.h"
+#include "AsyncConsumer.h"
+#include "Coroutines.h"
+#include "Benchmark.h"
+#include "ConsumerBenchmarks.h"
+
+#if defined(PPLAGENTS_COROUTINES)
+namespace Benchmarks
+{
+	// many mostly idle consumers: AsyncConsumerAgent (blocked, a thread each) and CoroutineAsyncConsumerAgent (suspended, a coroutine frame each)
+	namespace Coroutines
+	{
+		using Consumers::Small;
+
+		template<typename Consumer>
+		using BlockingConsumer = Agents::AgentComposer<Agents::AsyncConsumerAgent<Consumer>, Agents::Skills::AutoStart, Agents::Skills::AutoStopAndWait>;
+
+		template<typename Consumer>
+		using CoroutineConsumer = Agents::AgentComposer<Agents::CoroutineAsyncConsumerAgent<Consumer>, Agents::Skills::AutoStart, Agents::Skills::AutoStopAndWait>;
+
+		// starts "agents" consumers, sends one message to each of them, then stops and waits all of them
+		template<typename Agent>
+		Clock::duration TimeIdleConsumers(size_t agents)
+		{
+			std::vector<Concurrency::unbounded_buffer<Small>> buffers(agents);
+			std::vector<std::unique_ptr<Agent>> all;
+			all.reserve(agents);
+			const auto start = Clock::now();
+			for (auto& buffer : buffers)
+			{
+				all.push_back(std::make_unique<Agent>(buffer));
+			}
+			for (auto& buffer : buffers)
+			{
+				send(buffer, Small{});
+			}
+			for (auto& agent : all)
+			{
+				agent->Stop();
+			}
+			all.clear(); // waited
+			return Clock::now() - start;
+		}
+
+		template<typename Agent>
+		void MeasureLatency(const std::string& name, size_t samples)
+		{
+			Concurrency::unbounded_buffer<Consumers::Timed<Small>> buffer;
+			Concurrency::unbounded_buffer<bool> consumed;
+			std::vector<double> latencies;
+			latencies.reserve(samples);
+			{
+				Agent agent{ buffer, latencies, consumed };
+				for (size_t i = 0; i < samples; ++i)
+				{
+					send(buffer, Consumers::Timed<Small>{ Clock::now(), Small{} });
+					receive(consumed);
+				}
+			}
+			ReportLatency(name, latencies);
+		}
+
+		inline void RunAll(size_t agents)
+		{
+			Run("coroutine/" + std::to_string(agents) + " idle consumers, AsyncConsumerAgent", agents, [=] {
+				return TimeIdleConsumers<BlockingConsumer<Consumers::CountingConsumer<Small>>>(agents);
+			}, 3);
+			Run("coroutine/" + std::to_string(agents) + " idle consumers, CoroutineAsyncConsumerAgent", agents, [=] {
+				return TimeIdleConsumers<CoroutineConsumer<Consumers::CountingConsumer<Small>>>(agents);
+			}, 3);
+
+			MeasureLatency<BlockingConsumer<Consumers::LatencyConsumer<Small>>>("coroutine/latency, AsyncConsumerAgent", agents * 10);
+			MeasureLatency<CoroutineConsumer<Consumers::LatencyConsumer<Small>>>("coroutine/latency, CoroutineAsyncConsumerAgent", agents * 10);
+		}
+	}
+}
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include "AsyncConsumer.h"
+#include "PooledBuffer.h"
+#include "Benchmark.h"
+#include "ConsumerBenchmarks.h"
+
+namespace Benchmarks
+{
+	// time and heap allocations per message from send to Consume: unbounded_buffer and PooledBuffer (plus PayloadPool for strings)
+	namespace Pools
+	{
+		using Text = Agents::PayloadPool<std::string>::Handle;
+		using PooledText = Agents::Utils::Movable<Text>;
+
+		constexpr size_t TextLength = 100; // not fitting in the small string buffer
+
+		class TextConsumer
+		{
+		public:
+			explicit TextConsumer(Concurrency::ISource<PooledText>& buffer)
+				: m_buffer(buffer)
+			{
+
+			}
+		protected:
+			void Consume(Text text)
+			{
+				m_characters += text->size();
+			} // "text" goes back to the pool
+
+			Concurrency::ISource<PooledText>& m_buffer;
+		private:
+			size_t m_characters = 0;
+		};
+
+		template<typename Buffer, typename Consumer, typename Produce>
+		Clock::duration TimeSendAndConsume(size_t messages, Produce produce)
+		{
+			Buffer buffer;
+			const auto start = Clock::now();
+			{
+				Consumers::RAIIConsumer<Consumer> agent{ buffer };
+				for (size_t i = 0; i < messages; ++i)
+				{
+					produce(buffer);
+				}
+			}
+			return Clock::now() - start;
+		}
+
+		inline void RunAll(size_t messages)
+		{
+			RunCountingAllocations("pool/int, unbounded_buffer", messages, [=] {
+				return TimeSendAndConsume<Concurrency::unbounded_buffer<int>, Consumers::CountingConsumer<int>>(messages, [](auto& buffer) {
+					send(buffer, 42);
+				});
+			});
+			RunCountingAllocations("pool/int, PooledBuffer", messages, [=] {
+				return TimeSendAndConsume<Agents::PooledBuffer<int>, Consumers::CountingConsumer<int>>(messages, [](auto& buffer) {
+					Agents::Send(buffer, 42);
+				});
+			});
+
+			RunCountingAllocations("pool/string, unbounded_buffer", messages, [=] {
+				return TimeSendAndConsume<Concurrency::unbounded_buffer<std::string>, Consumers::CountingConsumer<std::string>>(messages, [](auto& buffer) {
+					send(buffer, std::string(TextLength, 'x'));
+				});
+			});
+			Agents::PayloadPool<std::string> texts;
+			RunCountingAllocations("pool/string, PooledBuffer and PayloadPool", messages, [=, &texts] {
+				return TimeSendAndConsume<Agents::PooledBuffer<PooledText>, TextConsumer>(messages, [&](auto& buffer) {
+					auto text = texts.Acquire();
+					text->assign(TextLength, 'x');
+					Agents::Send(buffer, PooledText{ std::move(text) });
+				});
+			});
+		}
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <array>
+#include <string>
+#include <vector>
+#include "AsyncConsumer.h"
+#include "PriorityAsyncConsumer.h"
+#include "Benchmark.h"
+#include "ConsumerBenchmarks.h"
+
+namespace Benchmarks
+{
+	// latency of a control message sent after a backlog of bulk messages: one buffer (FIFO) and two PriorityAsyncConsumerAgent lanes
+	namespace Priorities
+	{
+		using Message = Consumers::Timed<bool>; // Data: true for control messages
+
+		inline void Work(volatile unsigned& sink)
+		{
+			auto hash = 17u;
+			for (auto i = 0; i < 256; ++i)
+			{
+				hash = hash * 31u + 7u;
+			}
+			sink = hash;
+		}
+
+		class FifoConsumer
+		{
+		public:
+			FifoConsumer(Concurrency::ISource<Message>& buffer, std::vector<double>& latencies, Concurrency::ITarget<bool>& consumed)
+				: m_buffer(buffer), m_latencies(latencies), m_consumed(consumed)
+			{
+
+			}
+		protected:
+			void Consume(const Message& message)
+			{
+				Work(m_sink);
+				if (message.Data)
+				{
+					m_latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - message.Sent).count());
+					asend(m_consumed, true);
+				}
+			}
+
+			Concurrency::ISource<Message>& m_buffer;
+		private:
+			std::vector<double>& m_latencies;
+			Concurrency::ITarget<bool>& m_consumed;
+			volatile unsigned m_sink = 0;
+		};
+
+		class LaneConsumer
+		{
+		public:
+			LaneConsumer(Concurrency::ISource<Message>& control, Concurrency::ISource<Message>& bulk, std::vector<double>& latencies, Concurrency::ITarget<bool>& consumed)
+				: m_lanes{ &control, &bulk }, m_latencies(latencies), m_consumed(consumed)
+			{
+
+			}
+		protected:
+			void Consume(size_t lane, const Message& message)
+			{
+				Work(m_sink);
+				if (lane == 0)
+				{
+					m_latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - message.Sent).count());
+					asend(m_consumed, true);
+				}
+			}
+
+			std::array<Concurrency::ISource<Message>*, 2> m_lanes;
+		private:
+			std::vector<double>& m_latencies;
+			Concurrency::ITarget<bool>& m_consumed;
+			volatile unsigned m_sink = 0;
+		};
+
+		inline void MeasureFifo(size_t samples, size_t backlog)
+		{
+			using Agent = Agents::AsyncConsumer<FifoConsumer, Agents::Skills::AutoStart, Agents::Skills::AutoStop, Agents::Skills::AutoWait, Agents::Skills::DropLastValues>;
+			std::vector<double> latencies;
+			Concurrency::unbounded_buffer<Message> buffer;
+			Concurrency::unbounded_buffer<bool> consumed;
+			{
+				Agent agent{ buffer, latencies, consumed };
+				for (size_t i = 0; i < samples; ++i)
+				{
+					for (size_t j = 0; j < backlog; ++j)
+					{
+						send(buffer, Message{ Clock::now(), false });
+					}
+					send(buffer, Message{ Clock::now(), true });
+					receive(consumed);
+				}
+			}
+			ReportLatency("priority/control behind " + std::to_string(backlog) + " bulk, one buffer", latencies);
+		}
+
+		inline void MeasureLanes(size_t samples, size_t backlog)
+		{
+			using Agent = Agents::AgentComposer<Agents::PriorityAsyncConsumerAgent<LaneConsumer, Agents::Skills::DropLastValues>, Agents::Skills::AutoStart, Agents::Skills::AutoStopAndWait>;
+			std::vector<double> latencies;
+			Concurrency::unbounded_buffer<Message> control;
+			Concurrency::unbounded_buffer<Message> bulk;
+			Concurrency::unbounded_buffer<bool> consumed;
+			{
+				Agent agent{ control, bulk, latencies, consumed };
+				for (size_t i = 0; i < samples; ++i)
+				{
+					for (size_t j = 0; j < backlog; ++j)
+					{
+						send(bulk, Message{ Clock::now(), false });
+					}
+					send(control, Message{ Clock::now(), true });
+					receive(consumed);
+				}
+			}
+			ReportLatency("priority/control behind " + std::to_string(backlog) + " bulk, two lanes", latencies);
+		}
+
+		inline void RunAll(size_t samples)
+		{
+			MeasureFifo(samples, 1000);
+			MeasureLanes(samples, 1000);
+		}
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include "Agent.h"
+#include "Benchmark.h"
+
+namespace Benchmarks
+{
+	// per-message overhead of receiving from a buffer that already contains all the messages
+	namespace Receive
+	{
+		template<typename Drain>
+		Clock::duration TimeDrain(size_t messages, Drain drain)
+		{
+			Concurrency::unbounded_buffer<int> buffer;
+			for (size_t i = 0; i < messages; ++i)
+			{
+				send(buffer, static_cast<int>(i));
+			}
+			const auto start = Clock::now();
+			drain(buffer);
+			return Clock::now() - start;
+		}
+
+		// what the cancellable Receive used to do: a new choice for each message
+		inline bool PerMessageChoice(Concurrency::ISource<int>& source, Concurrency::single_assignment<bool>& stop, int& out)
+		{
+			auto received = false;
+			auto cancelled = false;
+			while (!received && !cancelled)
+			{
+				auto messageSource = Concurrency::make_choice(&stop, &source);
+				auto messageIdx = receive(messageSource);
+				cancelled = messageIdx != 1;
+				if (!cancelled && messageSource.has_value())
+				{
+					out = messageSource.template value<int>();
+					received = true;
+				}
+			}
+			return !cancelled;
+		}
+
+		inline void RunAll(size_t messages)
+		{
+			Run("receive/try_receive (no cancellation)", messages, [=] {
+				return TimeDrain(messages, [=](auto& buffer) {
+					int value = 0;
+					for (size_t i = 0; i < messages; ++i)
+					{
+						try_receive(buffer, value);
+					}
+				});
+			});
+
+			Run("receive/Concurrency::receive (no cancellation)", messages, [=] {
+				return TimeDrain(messages, [=](auto& buffer) {
+					for (size_t i = 0; i < messages; ++i)
+					{
+						receive(buffer);
+					}
+				});
+			});
+
+			Run("receive/make_choice per message", messages, [=] {
+				return TimeDrain(messages, [=](auto& buffer) {
+					Concurrency::single_assignment<bool> stop;
+					int value = 0;
+					for (size_t i = 0; i < messages; ++i)
+					{
+						PerMessageChoice(buffer, stop, value);
+					}
+				});
+			});
+
+			Run("receive/CancellableReceiver", messages, [=] {
+				return TimeDrain(messages, [=](auto& buffer) {
+					Agents::CancellationTokenSource source;
+					auto token = source.Token();
+					Agents::CancellableReceiver<int> receiver{ buffer, token };
+					int value = 0;
+					for (size_t i = 0; i < messages; ++i)
+					{
+						receiver.Receive(value);
+					}
+				});
+			});
+
+			Run("receive/Agents::Receive (cancellable)", messages, [=] {
+				return TimeDrain(messages, [=](auto& buffer) {
+					Agents::CancellationTokenSource source;
+					auto token = source.Token();
+					int value = 0;
+					for (size_t i = 0; i < messages; ++i)
+					{
+						Agents::Receive(buffer, token, value);
+					}
+				});
+			});
+
+			// cost of an expired timeout (0: no actual wait) on an empty buffer, e.g. a consumer waking up to flush
+			Run("receive/timed out, exception (Receive)", messages / 10, [=] {
+				Concurrency::unbounded_buffer<int> buffer;
+				Agents::CancellationTokenSource source;
+				auto token = source.Token();
+				Agents::CancellableReceiver<int> receiver{ buffer, token };
+				int value = 0;
+				const auto start = Clock::now();
+				for (size_t i = 0; i < messages / 10; ++i)
+				{
+					try
+					{
+						receiver.Receive(value, 0);
+					}
+					catch (const Concurrency::operation_timed_out&)
+					{
+					}
+				}
+				return Clock::now() - start;
+			});
+
+			Run("receive/timed out, ReceiveResult (ReceiveFor)", messages / 10, [=] {
+				Concurrency::unbounded_buffer<int> buffer;
+				Agents::CancellationTokenSource source;
+				auto token = source.Token();
+				Agents::CancellableReceiver<int> receiver{ buffer, token };
+				int value = 0;
+				const auto start = Clock::now();
+				for (size_t i = 0; i < messages / 10; ++i)
+				{
+					receiver.ReceiveFor(value, 0);
+				}
+				return Clock::now() - start;
+			});
+		}
+	}
+}
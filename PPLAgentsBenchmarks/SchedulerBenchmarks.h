@@ -0,0 +1,220 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Agent.h"
+#include "AgentComposer.h"
+#include "AgentPool.h"
+#include "Scheduling.h"
+#include "Benchmark.h"
+
+namespace Benchmarks
+{
+	// many short-lived agents: cost of Start + Wait on the default scheduler and on a dedicated one,
+	// and of one task at a time with a new agent each and with a lease from an AgentPool.
+	// Supervisors: time from one of many agents completing to its supervisor noticing, polling Status() and with Agent::WaitAny
+	namespace Schedulers
+	{
+		struct ShortLived : Agents::Agent
+		{
+		protected:
+			void Run(Agents::CancellationToken&) override
+			{
+			}
+		};
+
+		inline Clock::duration TimeStartAndWait(size_t agents, Agents::Scheduler* scheduler)
+		{
+			std::vector<std::unique_ptr<ShortLived>> all(agents);
+			for (auto& agent : all)
+			{
+				agent = std::make_unique<ShortLived>();
+				if (scheduler)
+				{
+					agent->SetScheduler(*scheduler);
+				}
+			}
+			const auto start = Clock::now();
+			for (auto& agent : all)
+			{
+				agent->Start();
+			}
+			for (auto& agent : all)
+			{
+				agent->Wait();
+			}
+			return Clock::now() - start;
+		}
+
+		struct ShortTask
+		{
+		protected:
+			void Run(Agents::CancellationToken&)
+			{
+			}
+		};
+
+		inline Clock::duration TimeNewAgentPerTask(size_t tasks)
+		{
+			const auto start = Clock::now();
+			for (size_t i = 0; i < tasks; ++i)
+			{
+				ShortLived agent;
+				agent.Start();
+				agent.Wait();
+			}
+			return Clock::now() - start;
+		}
+
+		inline Clock::duration TimeLeasePerTask(size_t tasks, Agents::AgentPool<ShortTask>& pool)
+		{
+			const auto start = Clock::now();
+			for (size_t i = 0; i < tasks; ++i)
+			{
+				Agents::AgentComposer<Agents::AgentPool<ShortTask>::Lease, Agents::Skills::AutoStart, Agents::Skills::AutoWait> lease{ pool };
+			}
+			return Clock::now() - start;
+		}
+
+		// throws when told to: its worker must stay usable by the next lease
+		class FailingTask
+		{
+		public:
+			explicit FailingTask(bool fail) : m_fail(fail)
+			{
+			}
+		protected:
+			void Run(Agents::CancellationToken&)
+			{
+				if (m_fail)
+				{
+					throw std::runtime_error("failing task");
+				}
+			}
+		private:
+			bool m_fail;
+		};
+
+		// like TimeLeasePerTask, every other job throwing: the exception reaches the lease and the worker is reused
+		inline Clock::duration TimeLeaseAfterFailure(size_t tasks, Agents::AgentPool<FailingTask>& pool)
+		{
+			const auto start = Clock::now();
+			for (size_t i = 0; i < tasks; ++i)
+			{
+				const auto fail = i % 2 == 0;
+				Agents::AgentComposer<Agents::AgentPool<FailingTask>::Lease, Agents::Skills::AutoStart, Agents::Skills::AutoWait> lease{ pool, fail };
+				lease.Wait();
+				if ((lease.Error() != nullptr) != fail)
+				{
+					throw std::logic_error("AgentPool: the exception of a job is not reported to its lease");
+				}
+			}
+			if (pool.Workers() != 1)
+			{
+				throw std::logic_error("AgentPool: a throwing job has lost its worker");
+			}
+			return Clock::now() - start;
+		}
+
+		// returns when told to, after storing when it finished
+		class Finishing : public Agents::Agent
+		{
+		public:
+			void Finish()
+			{
+				send(m_finish, true);
+			}
+
+			Clock::time_point Finished() const
+			{
+				return Clock::time_point{ Clock::duration{ m_finished.load(std::memory_order_acquire) } };
+			}
+		protected:
+			void Run(Agents::CancellationToken&) override
+			{
+				receive(m_finish);
+				m_finished.store(Clock::now().time_since_epoch().count(), std::memory_order_release);
+			}
+		private:
+			Concurrency::unbounded_buffer<bool> m_finish;
+			std::atomic<Clock::rep> m_finished = 0;
+		};
+
+		// "wait" blocks until one of "agents" has completed and returns its index
+		template<typename WaitForOne>
+		void MeasureSupervisor(const std::string& name, size_t samples, size_t agents, WaitForOne wait)
+		{
+			std::vector<double> latencies;
+			latencies.reserve(samples);
+			for (size_t sample = 0; sample < samples; ++sample)
+			{
+				std::vector<std::unique_ptr<Finishing>> all(agents);
+				std::vector<Agents::Agent*> group;
+				for (auto& agent : all)
+				{
+					agent = std::make_unique<Finishing>();
+					group.push_back(agent.get());
+					agent->Start();
+				}
+				auto& finishing = *all[sample % agents];
+				finishing.Finish();
+				const auto index = wait(Agents::Utils::span<Agents::Agent* const>{ group.data(), group.size() });
+				latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - all[index]->Finished()).count());
+				for (auto& agent : all)
+				{
+					agent->Finish();
+				}
+				Agents::Agent::WaitAll(Agents::Utils::span<Agents::Agent* const>{ group.data(), group.size() });
+			}
+			ReportLatency(name, latencies);
+		}
+
+		inline void RunAll(size_t agents)
+		{
+			Run("scheduler/short-lived agents, default scheduler", agents, [=] {
+				return TimeStartAndWait(agents, nullptr);
+			});
+
+			Agents::Scheduler dedicated{ { 2, std::nullopt } };
+			Run("scheduler/short-lived agents, dedicated scheduler", agents, [&] {
+				return TimeStartAndWait(agents, &dedicated);
+			});
+
+			RunCountingAllocations("scheduler/one task at a time, new agent", agents, [=] {
+				return TimeNewAgentPerTask(agents);
+			});
+
+			Agents::AgentPool<ShortTask> pool{ 1 };
+			RunCountingAllocations("scheduler/one task at a time, AgentPool lease", agents, [&] {
+				return TimeLeasePerTask(agents, pool);
+			});
+
+			Agents::AgentPool<FailingTask> failingPool{ 1 };
+			Run("scheduler/one task at a time, AgentPool lease, every other job throwing", agents, [&] {
+				return TimeLeaseAfterFailure(agents, failingPool);
+			});
+
+			constexpr size_t supervised = 16;
+			MeasureSupervisor("scheduler/supervisor noticing completion, polling every 1 ms", agents / 100, supervised, [](Agents::Utils::span<Agents::Agent* const> group) {
+				while (true)
+				{
+					for (size_t i = 0; i < group.size(); ++i)
+					{
+						if (group[i]->Status() == Agents::AgentStatus::Completed)
+						{
+							return i;
+						}
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			});
+			MeasureSupervisor("scheduler/supervisor noticing completion, WaitAny", agents / 100, supervised, [](Agents::Utils::span<Agents::Agent* const> group) {
+				return Agents::Agent::WaitAny(group);
+			});
+		}
+	}
+}
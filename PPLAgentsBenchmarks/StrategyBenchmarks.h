@@ -0,0 +1,108 @@
+#pragma once
+#include <functional>
+#include "StrategyBasedAsyncConsumer.h"
+#include "Benchmark.h"
+
+namespace Benchmarks
+{
+	// cost of dispatching one message to the user action: polymorphic strategy vs compile-time strategy vs plain Consume
+	namespace Strategies
+	{
+		// exposes Consume, so the dispatch can be measured without the receive
+		template<typename Consumer>
+		struct Exposed : Consumer
+		{
+			using Consumer::Consumer;
+			using Consumer::Consume;
+		};
+
+		struct DirectConsumer
+		{
+			DirectConsumer(Concurrency::ISource<int>& buffer, long long& sum)
+				: m_buffer(buffer), m_sum(sum)
+			{
+
+			}
+
+			void Consume(int value)
+			{
+				m_sum += value;
+			}
+
+			Concurrency::ISource<int>& m_buffer;
+		private:
+			long long& m_sum;
+		};
+
+		template<typename Consumer>
+		Clock::duration TimeDispatch(size_t messages, Consumer& consumer)
+		{
+			const auto start = Clock::now();
+			for (size_t i = 0; i < messages; ++i)
+			{
+				consumer.Consume(static_cast<int>(i));
+			}
+			return Clock::now() - start;
+		}
+
+		template<typename Agent, typename... Args>
+		Clock::duration TimeEndToEnd(size_t messages, Args&&... args)
+		{
+			Concurrency::unbounded_buffer<int> buffer;
+			const auto start = Clock::now();
+			{
+				Agent agent{ buffer, std::forward<Args>(args)... };
+				for (size_t i = 0; i < messages; ++i)
+				{
+					send(buffer, static_cast<int>(i));
+				}
+			}
+			return Clock::now() - start;
+		}
+
+		// through the agent: is the dispatch difference still visible next to the receive?
+		inline void RunEndToEnd(size_t messages, long long& sum)
+		{
+			auto action = [&sum](const int& value) { sum += value; };
+
+			Run("strategy/end to end direct Consumer", messages, [&] {
+				return TimeEndToEnd<Agents::AsyncConsumer<DirectConsumer, Agents::Skills::AutoStart, Agents::Skills::AutoStop, Agents::Skills::AutoWait, Agents::Skills::RetainLastValues>>(messages, sum);
+			});
+
+			Run("strategy/end to end StrategyBasedAsyncConsumer", messages, [&] {
+				return TimeEndToEnd<Agents::StrategyBasedAsyncConsumer<int>>(messages, std::make_unique<Agents::CallableConsumerStrategy<int>>(action));
+			});
+
+			Run("strategy/end to end compile-time strategy", messages, [&] {
+				return TimeEndToEnd<Agents::StrategyBasedAsyncConsumer<int, decltype(action)>>(messages, action);
+			});
+		}
+
+		inline void RunAll(size_t messages)
+		{
+			Concurrency::unbounded_buffer<int> buffer;
+			long long sum = 0;
+			auto action = [&sum](const int& value) { sum += value; };
+
+			Run("strategy/direct Consume", messages, [&] {
+				Exposed<DirectConsumer> consumer{ buffer, sum };
+				return TimeDispatch(messages, consumer);
+			});
+
+			Run("strategy/polymorphic (CallableConsumerStrategy)", messages, [&] {
+				Exposed<Agents::ConsumerWithStrategy<int>> consumer{ buffer, std::make_unique<Agents::CallableConsumerStrategy<int>>(action) };
+				return TimeDispatch(messages, consumer);
+			});
+
+			Run("strategy/compile-time (lambda)", messages, [&] {
+				Exposed<Agents::ConsumerWithStrategy<int, decltype(action)>> consumer{ buffer, action };
+				return TimeDispatch(messages, consumer);
+			});
+
+			RunEndToEnd(messages / 10, sum);
+
+			// the sum is printed so the compiler can't throw the loops away
+			Report("strategy/checksum", static_cast<double>(sum % 1000), "(ignore)");
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include "ConsumerBenchmarks.h"
+#include "CopyBenchmarks.h"
+#include "CoroutineBenchmarks.h"
+#include "PoolBenchmarks.h"
+#include "PriorityBenchmarks.h"
+#include "ReceiveBenchmarks.h"
+#include "SchedulerBenchmarks.h"
+#include "StrategyBenchmarks.h"
+
+// counts heap allocations (see Benchmarks::RunCountingAllocations)
+void* operator new(size_t size)
+{
+	Benchmarks::Allocations().fetch_add(1, std::memory_order_relaxed);
+	if (auto* pointer = std::malloc(size ? size : 1))
+	{
+		return pointer;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	std::free(pointer);
+}
+
+// PPLAgentsBenchmarks [--json <file>]
+// --json also writes the results to <file> (machine-readable, to compare runs)
+int main(int argc, char* argv[])
+{
+	const char* jsonPath = nullptr;
+	for (auto i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+		{
+			jsonPath = argv[++i];
+		}
+		else
+		{
+			std::cerr << "usage: " << argv[0] << " [--json <file>]\n";
+			return 1;
+		}
+	}
+
+	constexpr size_t messages = 1'000'000;
+
+	Benchmarks::Receive::RunAll(messages);
+	Benchmarks::Consumers::RunAll(messages);
+	Benchmarks::Copies::RunAll(messages / 10);
+	Benchmarks::Priorities::RunAll(messages / 10000);
+	Benchmarks::Pools::RunAll(messages / 10);
+	Benchmarks::Strategies::RunAll(messages * 10);
+	Benchmarks::Schedulers::RunAll(messages / 100);
+#if defined(PPLAGENTS_COROUTINES)
+	Benchmarks::Coroutines::RunAll(messages / 1000);
+#endif
+
+	if (jsonPath)
+	{
+		std::ofstream json{ jsonPath };
+		Benchmarks::WriteJson(json);
+		if (!json)
+		{
+			std::cerr << "can't write " << jsonPath << "\n";
+			return 1;
+		}
+	}
+}